@@ -0,0 +1,138 @@
+/*
+  aggregator.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef aggregator_hpp
+#define aggregator_hpp
+
+#include <mutex>
+#include <limits>
+#include <stdlib.h>
+
+#include "task_runtime.hpp"
+#include "vertex_values.hpp"    /* CACHE_LINE_SIZE */
+
+namespace GraphSN {
+  
+  /* monoids of the aggregators, identity() and the combination of two values */
+  template <typename T>
+  struct SumMonoid{
+    T identity() const { return T(); }
+    T operator()(T a, T b) const { return a + b; }
+  };
+  
+  template <typename T>
+  struct MinMonoid{
+    T identity() const { return std::numeric_limits<T>::max(); }
+    T operator()(T a, T b) const { return (b < a) ? b : a; }
+  };
+  
+  template <typename T>
+  struct MaxMonoid{
+    T identity() const { return std::numeric_limits<T>::lowest(); }
+    T operator()(T a, T b) const { return (a < b) ? b : a; }
+  };
+  
+  struct OrMonoid{
+    bool identity() const { return false; }
+    bool operator()(bool a, bool b) const { return a || b; }
+  };
+  
+  class AggregatorBase{
+    
+  public:
+    
+    virtual ~AggregatorBase() {}
+    
+    virtual void reset() = 0;
+    virtual void merge() = 0;
+  };
+  
+  /*
+      Reduction of the values added by the updates. Every worker of the runtime combines values
+      into its own cache line, threads outside the runtime share one slot under a lock. The slots
+      are merged by the engine, so adding a value never contends with other workers.
+  */
+  template <typename T, typename Monoid>
+  class Aggregator: public AggregatorBase{
+    
+    union Slot_t{
+      T     value;
+      char  line[((sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE];
+    };
+    
+    Monoid        monoid;
+    uint32_t      slots_num;
+    Slot_t *      slots;          /* slot 0 belongs to threads outside the runtime */
+    T             merged;
+    std::mutex    external_mtx;
+    
+  public:
+    
+    Aggregator(Monoid monoid): monoid(monoid), slots_num(runtime.get_workers_num() + 1)
+    {
+      if (posix_memalign(reinterpret_cast<void **>(&slots), CACHE_LINE_SIZE, slots_num * sizeof(Slot_t))){
+        handle_error("allocating aggregator slots");
+      }
+      reset();
+    }
+    
+    ~Aggregator()
+    {
+      free(slots);
+    }
+    
+    /**
+     * add
+     *
+     * Combines a value into the slot of the calling thread
+     *
+     * @param   value   value
+     * @return  void
+     */
+    void add(T value)
+    {
+      int32_t workerID = TaskRuntime::worker_id();
+      
+      if (workerID >= 0){
+        CHECK((uint32_t) workerID + 1 < slots_num);
+        slots[workerID + 1].value = monoid(slots[workerID + 1].value, value);
+      }
+      else{
+        std::lock_guard<std::mutex> lock(external_mtx);
+        slots[0].value = monoid(slots[0].value, value);
+      }
+    }
+    
+    /**
+     * get
+     *
+     * @return  value of the iteration, merged up to the last finished interval
+     */
+    T get()
+    {
+      return merged;
+    }
+    
+    /* called by the engine while no update runs */
+    void merge()
+    {
+      for (uint32_t i = 0; i < slots_num; i++){
+        merged = monoid(merged, slots[i].value);
+        slots[i].value = monoid.identity();
+      }
+    }
+    
+    void reset()
+    {
+      merged = monoid.identity();
+      for (uint32_t i = 0; i < slots_num; i++){
+        slots[i].value = monoid.identity();
+      }
+    }
+  };
+}
+
+#endif /* aggregator_hpp */
@@ -7,11 +7,14 @@
 #ifndef cache_hpp
 #define cache_hpp
 #define CACHE_BLOCK_SIZE (64L*1024L*1024L)
+#define CACHE_READ_BLOCKS 4   /* missed blocks read together */
 
 #include <list>
 #include <algorithm>
 #include <unordered_map>
 
+#include "io_backend.hpp"
+
 uint32_t sum_hit_rate = 0, gsum = 0;
 
 namespace GraphSN{
@@ -28,8 +31,9 @@ namespace GraphSN{
     full_cache
   };
   
+  /* blocks hold bytes of the edge data files, whatever the width of the edge values */
   typedef struct Cacheblock_s{
-    value_t * data;
+    char * data;
     uint32_t block_num;
     long long size;
   }Cacheblock_t;
@@ -37,6 +41,7 @@ namespace GraphSN{
   class Cache{
     
   public:
+    Cache(): mode(no_cache), max_size(0), interval_edata_bytes(NULL){}
     virtual ~Cache(){};
     
   protected:
@@ -97,7 +102,7 @@ namespace GraphSN{
     * 
     * @param    shardID       shardID
     * @param    start_offset  starting offset
-    * @param    end_offset    ending offset
+    * @param    end_offset    ending offset (exclusive)
     * @return   void
     */
     std::pair<uint32_t, uint32_t> find_needed_blocks(uint32_t shardID,
@@ -107,12 +112,37 @@ namespace GraphSN{
       
       base_blockID = cacheblocks_bounds[shardID].first;
       first_blockID = (uint32_t) (base_blockID + start_offset / CACHE_BLOCK_SIZE);
-      last_blockID = (uint32_t) (base_blockID + end_offset / CACHE_BLOCK_SIZE);
+      last_blockID = (uint32_t) (base_blockID + (end_offset - 1) / CACHE_BLOCK_SIZE);
       
       return std::make_pair(first_blockID, last_blockID);
     }
     
-    virtual void add(value_t * data, long long size, uint32_t block_num) = 0;
+    /**
+    * block_bounds
+    *
+    * Find the part of a cache block that lies in [start_offset, end_offset)
+    * 
+    * @param    intervalID      intervalID
+    * @param    block           block of the interval
+    * @param    start_offset    starting offset
+    * @param    end_offset      ending offset (exclusive)
+    * @param    start           first byte of the block to be used
+    * @param    bytes_to_copy   number of bytes of the block to be used
+    * @return   position of the first byte inside [start_offset, end_offset)
+    */
+    uint32_t block_bounds(uint32_t intervalID, uint32_t block, off_t start_offset, off_t end_offset,
+                          off_t& start, off_t& bytes_to_copy)
+    {
+      off_t block_offset = (off_t) (block - cacheblocks_bounds[intervalID].first) * CACHE_BLOCK_SIZE;
+      off_t first = std::max(start_offset, block_offset);
+      off_t last = std::min(end_offset, block_offset + CACHE_BLOCK_SIZE);
+      
+      start = first - block_offset;
+      bytes_to_copy = last - first;
+      return (uint32_t) (first - start_offset);
+    }
+    
+    virtual void add(char * data, long long size, uint32_t block_num) = 0;
     virtual void change_priority(uint32_t blockID) = 0;
     
     /**
@@ -128,39 +158,21 @@ namespace GraphSN{
     * @return   void
     */
     void load_from_cache(uint32_t intervalID, std::pair <uint32_t, uint32_t> block_interval, off_t start_offset,
-                         off_t end_offset, value_t * &arrEdgedata)
+                         off_t end_offset, char * arrEdgedata)
     {
-      int32_t fd_edges;
-      uint32_t elements_written;
-      off_t start, bytes_to_copy;
-      std::string edata_filename = std::string(edge_data_filename + std::to_string(intervalID));
-      
-      elements_written = 0;
-      fd_edges = open(edata_filename.c_str(), O_RDONLY, 0777);
-      if (fd_edges == -1) handle_error(("opening "+ edata_filename).c_str());
-      
       /* in this loop we are loading data from cache */
       for (uint32_t block = block_interval.first; block <= block_interval.second; block++){
         std::unordered_map <uint32_t, Cacheblock_t *>::const_iterator element = hHashMap.find(block);
+        uint32_t bytes_written;
+        off_t start, bytes_to_copy;
+        
         CHECK(element != hHashMap.end());
-        if (block == block_interval.first){
-          start = start_offset % CACHE_BLOCK_SIZE;
-        }
-        else{
-          start = 0;
-        }
-        if (block == block_interval.second && end_offset != CACHE_BLOCK_SIZE){
-          bytes_to_copy = end_offset % CACHE_BLOCK_SIZE - start;
-        }
-        else{
-          bytes_to_copy = CACHE_BLOCK_SIZE - start;
-        }
-        memcpy(&arrEdgedata[elements_written], &element->second->data[start / sizeof(value_t)], bytes_to_copy);
-        elements_written += bytes_to_copy / sizeof(value_t);
+        bytes_written = block_bounds(intervalID, block, start_offset, end_offset, start, bytes_to_copy);
+        memcpy(&arrEdgedata[bytes_written], &element->second->data[start], bytes_to_copy);
       }
-      sum_hit_rate += block_interval.second + 1;
-      gsum += block_interval.second + 1;
-      LOG("%1$u/%1$u hit(s)\n", block_interval.second + 1);
+      sum_hit_rate += block_interval.second - block_interval.first + 1;
+      gsum += block_interval.second - block_interval.first + 1;
+      LOG("%1$u/%1$u hit(s)\n", block_interval.second - block_interval.first + 1);
     }
     
     /**
@@ -176,97 +188,58 @@ namespace GraphSN{
     * @return   void
     */
     void load(uint32_t intervalID, std::pair <uint32_t, uint32_t> block_interval, off_t start_offset,
-              off_t end_offset, value_t * &arrEdgedata)
+              off_t end_offset, char * arrEdgedata)
     {
-      off_t offset;
-      int32_t fd_edges;
-      uint32_t hit_counter = 0;
-      uint32_t elements_written, elements_written_base;
-      off_t start, bytes_to_copy;
-      value_t * arrTmp;
+      uint32_t hit_counter = 0, first_read = 0, reads_end = 0, miss = 0;
+      char * arrTmp;
+      std::vector <uint32_t> misses;
       std::string edata_filename = std::string(edge_data_filename + std::to_string(intervalID));
-      
-      fd_edges = open(edata_filename.c_str(), O_RDONLY, 0777);
-      if (fd_edges == -1) handle_error(("opening "+ edata_filename).c_str());
+      long file_size = GetFileSize(edata_filename);
       
       /* in this loop we are taking data from cache */
-      elements_written_base = (CACHE_BLOCK_SIZE - start_offset % CACHE_BLOCK_SIZE) / sizeof(value_t);
-            
-#pragma omp parallel for
-      for (uint32_t block = block_interval.first; block <= block_interval.second; block++){
+      parallel_for<uint32_t>(block_interval.first, block_interval.second + 1, [&](uint32_t block){
         std::unordered_map <uint32_t, Cacheblock_t *>::const_iterator element = hHashMap.find(block);
-        uint32_t elements_written;
+        uint32_t bytes_written;
         off_t start, bytes_to_copy;
         
         if (element != hHashMap.end()){
-          if (block == block_interval.first){
-            start = start_offset % CACHE_BLOCK_SIZE;
-          }
-          else{
-            start = 0;
-          }
-          if (block == block_interval.second && end_offset != CACHE_BLOCK_SIZE){
-            bytes_to_copy = end_offset % CACHE_BLOCK_SIZE - start;
-          }
-          else{
-            bytes_to_copy = CACHE_BLOCK_SIZE - start;
-          }
-          if (block != block_interval.first){
-            elements_written = elements_written_base + (block - block_interval.first - 1) * CACHE_BLOCK_SIZE;
-          }
-          else{
-            elements_written = 0;
-          }
+          bytes_written = block_bounds(intervalID, block, start_offset, end_offset, start, bytes_to_copy);
           __sync_add_and_fetch(&hit_counter, 1);
-          memcpy(&arrEdgedata[elements_written], &element->second->data[start / sizeof(value_t)], bytes_to_copy);
+          memcpy(&arrEdgedata[bytes_written], &element->second->data[start], bytes_to_copy);
         }
-      }
+      }, 1u);
       
-      elements_written = 0;
-      offset = CACHE_BLOCK_SIZE * (block_interval.first - cacheblocks_bounds[intervalID].first);
-      arrTmp = (value_t *) malloc(CACHE_BLOCK_SIZE);
-      
-      long file_size = GetFileSize(edata_filename);
       for (uint32_t block = block_interval.first; block <= block_interval.second; block++){
-        std::unordered_map <uint32_t, Cacheblock_t *>::const_iterator element = hHashMap.find(block);
-        if (element != hHashMap.end()){ /* it is in cache */
-          change_priority(element->first);
+        if (hHashMap.find(block) == hHashMap.end()){
+          misses.push_back(block);
         }
-        else{
-          uint32_t bsize;
+      }
+      arrTmp = (char *) malloc(std::min<size_t>(misses.size(), CACHE_READ_BLOCKS) * CACHE_BLOCK_SIZE);
+      for (uint32_t block = block_interval.first; block <= block_interval.second; block++){
+        if (miss < misses.size() && misses[miss] == block){
+          uint32_t bytes_written;
+          off_t start, bytes_to_copy;
           
-          if (block == cacheblocks_bounds[intervalID].second - 1 && file_size % CACHE_BLOCK_SIZE){
-            bsize = file_size % CACHE_BLOCK_SIZE;
-          }
-          else{
-            bsize = CACHE_BLOCK_SIZE;
-          }
-          pread_sys(reinterpret_cast<char*>(&arrTmp[0]), bsize, offset, fd_edges);
-          add(arrTmp, bsize, block);
-          if (block == block_interval.first){
-            start = start_offset % CACHE_BLOCK_SIZE;
-          }
-          else{
-            start = 0;
-          }
-          if (block == block_interval.second && end_offset != CACHE_BLOCK_SIZE){
-            bytes_to_copy = end_offset % CACHE_BLOCK_SIZE - start;
-          }
-          else{
-            bytes_to_copy = CACHE_BLOCK_SIZE - start;
+          /* the next missed blocks are read together, with the reads queued by the shards */
+          if (miss == reads_end){
+            first_read = miss;
+            reads_end = std::min<uint32_t>(miss + CACHE_READ_BLOCKS, misses.size());
+            for (uint32_t i = first_read; i < reads_end; i++){
+              io().queue(edata_filename, &arrTmp[(uint64_t) (i - first_read) * CACHE_BLOCK_SIZE], block_size(intervalID, misses[i], file_size),
+                         CACHE_BLOCK_SIZE * (off_t) (misses[i] - cacheblocks_bounds[intervalID].first));
+            }
+            io().complete();
           }
-          memcpy(&arrEdgedata[elements_written], &arrTmp[start / sizeof(value_t)], bytes_to_copy);
+          add(&arrTmp[(uint64_t) (miss - first_read) * CACHE_BLOCK_SIZE], block_size(intervalID, block, file_size), block);
+          bytes_written = block_bounds(intervalID, block, start_offset, end_offset, start, bytes_to_copy);
+          memcpy(&arrEdgedata[bytes_written], &arrTmp[(uint64_t) (miss - first_read) * CACHE_BLOCK_SIZE + start], bytes_to_copy);
+          miss++;
         }
-        if (block == block_interval.first && start_offset != CACHE_BLOCK_SIZE){
-          elements_written += (CACHE_BLOCK_SIZE - start_offset % CACHE_BLOCK_SIZE) / sizeof(value_t);
+        else{ /* it is in cache */
+          change_priority(block);
         }
-        else{
-          elements_written += CACHE_BLOCK_SIZE / sizeof(value_t);
-        }
-        offset += CACHE_BLOCK_SIZE;
       }
       free(arrTmp);
-      close(fd_edges);
       sum_hit_rate += hit_counter;
       gsum += block_interval.second - block_interval.first + 1;
       LOG("%u/%u hit(s) in interval %u\n", hit_counter, block_interval.second - block_interval.first + 1, intervalID);
@@ -281,36 +254,45 @@ namespace GraphSN{
     */
     void load_fully()
     {
-      value_t * arrTmp;
+      char * arrTmp;
       
-      arrTmp = (value_t *) malloc(CACHE_BLOCK_SIZE);
+      arrTmp = (char *) malloc(CACHE_READ_BLOCKS * CACHE_BLOCK_SIZE);
       for (uint16_t interval = 0; interval < intervals_number; interval++){
-        int32_t fd;
-        off_t offset = 0;
         std::string edata_filename = std::string(edge_data_filename + std::to_string(interval));
-        fd = open(edata_filename.c_str(), O_RDONLY, 0777);
-        if (fd == -1) handle_error(("opening "+ edata_filename).c_str());
+        long file_size = GetFileSize(edata_filename);
         
-        long long file_size = GetFileSize(edata_filename);
-        for (uint32_t block = cacheblocks_bounds[interval].first; block < cacheblocks_bounds[interval].second; block++){
-          uint32_t bsize;
+        for (uint32_t first = cacheblocks_bounds[interval].first; first < cacheblocks_bounds[interval].second; first += CACHE_READ_BLOCKS){
+          uint32_t last = std::min<uint32_t>(first + CACHE_READ_BLOCKS, cacheblocks_bounds[interval].second);
           
-          if (block == cacheblocks_bounds[interval].second - 1 && file_size % CACHE_BLOCK_SIZE){
-            bsize = file_size % CACHE_BLOCK_SIZE;
+          for (uint32_t block = first; block < last; block++){
+            io().queue(edata_filename, &arrTmp[(uint64_t) (block - first) * CACHE_BLOCK_SIZE], block_size(interval, block, file_size),
+                       CACHE_BLOCK_SIZE * (off_t) (block - cacheblocks_bounds[interval].first));
           }
-          else{
-            bsize = CACHE_BLOCK_SIZE;
+          io().complete();
+          for (uint32_t block = first; block < last; block++){
+            add(&arrTmp[(uint64_t) (block - first) * CACHE_BLOCK_SIZE], block_size(interval, block, file_size), block);
           }
-          
-          pread_sys(reinterpret_cast<char*>(&arrTmp[0]), bsize, offset, fd);
-          add(arrTmp, bsize, block);
-          offset += CACHE_BLOCK_SIZE;
         }
-        close(fd);
       }
       free(arrTmp);
     }
     
+    /**
+    * block_size
+    *
+    * @param    intervalID      intervalID
+    * @param    block           block of the interval
+    * @param    file_size       size of the edge data file of the interval
+    * @return   bytes of the block, the last one may be smaller
+    */
+    uint32_t block_size(uint32_t intervalID, uint32_t block, long file_size)
+    {
+      if (block == cacheblocks_bounds[intervalID].second - 1 && file_size % CACHE_BLOCK_SIZE){
+        return file_size % CACHE_BLOCK_SIZE;
+      }
+      return CACHE_BLOCK_SIZE;
+    }
+    
   public:
     
     virtual void setArrays(Outbound_t ** outbound_indices_arr, DegreeData_t * inbound_degrees_arr,
@@ -334,16 +316,49 @@ namespace GraphSN{
       print("\n");
     }
     
-    void search_and_retrieve(uint32_t intervalID, off_t start_offset, off_t end_offset, value_t * arrEdgedata)
+    template <typename EdgeValue>
+    void search_and_retrieve(uint32_t intervalID, off_t start_offset, off_t end_offset, EdgeValue * arrEdgedata)
     {
       std::pair <uint32_t, uint32_t> block_interval;
       
       block_interval = find_needed_blocks(intervalID, start_offset, end_offset);
       if (mode == semi_cache){
-        load(intervalID, block_interval, start_offset, end_offset, arrEdgedata);
+        load(intervalID, block_interval, start_offset, end_offset, reinterpret_cast<char*>(arrEdgedata));
       }
       else{
-        load_from_cache(intervalID, block_interval, start_offset, end_offset, arrEdgedata);
+        load_from_cache(intervalID, block_interval, start_offset, end_offset, reinterpret_cast<char*>(arrEdgedata));
+      }
+    }
+    
+    /**
+    * update
+    *
+    * Copy modified edge data in the cached blocks that contain it
+    * 
+    * @param    intervalID      intervalID
+    * @param    start_offset    starting offset in the edge data file
+    * @param    end_offset      ending offset in the edge data file (exclusive)
+    * @param    arrEdgedata     modified edge data of [start_offset, end_offset)
+    * @return   void
+    */
+    void update(uint32_t intervalID, off_t start_offset, off_t end_offset, char * arrEdgedata)
+    {
+      std::pair <uint32_t, uint32_t> block_interval;
+      
+      if (mode == no_cache){
+        return;
+      }
+      block_interval = find_needed_blocks(intervalID, start_offset, end_offset);
+      for (uint32_t block = block_interval.first; block <= block_interval.second; block++){
+        std::unordered_map <uint32_t, Cacheblock_t *>::const_iterator element = hHashMap.find(block);
+        uint32_t bytes_read;
+        off_t start, bytes_to_copy;
+        
+        if (element == hHashMap.end()){
+          continue;
+        }
+        bytes_read = block_bounds(intervalID, block, start_offset, end_offset, start, bytes_to_copy);
+        memcpy(&element->second->data[start], &arrEdgedata[bytes_read], bytes_to_copy);
       }
     }
   };
@@ -360,13 +375,13 @@ namespace GraphSN{
       }
     }
     
-    void add(value_t * data, long long size, uint32_t block_num)
+    void add(char * data, long long size, uint32_t block_num)
     {
       Cacheblock_t cache_block;
       
       CHECK(size > 0);
       
-      cache_block.data = (value_t *) malloc(size);
+      cache_block.data = (char *) malloc(size);
       memcpy(cache_block.data, data, size);
       cache_block.size = size;
       cache_block.block_num = block_num;
@@ -427,6 +442,7 @@ namespace GraphSN{
   class IndegreeCache: public Cache{
     
     bool            keep_vertices_in_memory;
+    size_t          edge_value_size;
     value_t         * arr_indegree_values;
     uint32_t        * arr_outbound_number, arr_inbound_number, * arr_shard_edges;
     Outbound_t      ** outbound_indices_arr;
@@ -435,7 +451,8 @@ namespace GraphSN{
     
     void determine_indegree_values()
     {
-      uint32_t elements_per_block = CACHE_BLOCK_SIZE / sizeof(value_t);
+      /* edges that start in a block */
+      uint32_t elements_per_block = (uint32_t) ((CACHE_BLOCK_SIZE + edge_value_size - 1) / edge_value_size);
       uint32_t cache_blocks_num = (uint32_t) cacheblocks_bounds.back().second;
       uint32_t * indegrees;
       vertex_t * arrCurShard;
@@ -452,8 +469,10 @@ namespace GraphSN{
       for (uint16_t interval = 0; interval < intervals_number; interval++){
         index_t  outbound_index = 0;
         for (uint32_t blockID = cacheblocks_bounds[interval].first; blockID < cacheblocks_bounds[interval].second; blockID++){
-          uint32_t start = (blockID - cacheblocks_bounds[interval].first) * elements_per_block;
-          uint32_t end = ((blockID == cacheblocks_bounds[interval].second - 1) ? arr_shard_edges[interval] : start + elements_per_block) - 1;
+          off_t    block_offset = (off_t) (blockID - cacheblocks_bounds[interval].first) * CACHE_BLOCK_SIZE;
+          uint32_t start = (uint32_t) ((block_offset + edge_value_size - 1) / edge_value_size);
+          uint32_t end = ((blockID == cacheblocks_bounds[interval].second - 1) ? arr_shard_edges[interval] :
+                          (uint32_t) ((block_offset + CACHE_BLOCK_SIZE + edge_value_size - 1) / edge_value_size)) - 1;
           value_t  current_value;
           vertex_t prev;
           uint32_t distinct_sources = 0, starting_outbound_index, size;
@@ -510,7 +529,7 @@ namespace GraphSN{
       }
     }
     
-    void add(value_t * data, long long size, uint32_t block_num)
+    void add(char * data, long long size, uint32_t block_num)
     {
       value_t value_to_add;
       Cacheblock_t cache_block;
@@ -531,7 +550,7 @@ namespace GraphSN{
         hList.pop_back();
       }
       
-      cache_block.data = (value_t *) malloc(size);
+      cache_block.data = (char *) malloc(size);
       memcpy(cache_block.data, data, size);
       cache_block.size = size;
       cache_block.block_num = block_num;
@@ -553,7 +572,8 @@ namespace GraphSN{
     
   public:
     
-    IndegreeCache(uint64_t size)
+    IndegreeCache(uint64_t size, size_t edge_value_size): edge_value_size(edge_value_size), arr_indegree_values(NULL),
+    arr_outbound_number(NULL), arr_shard_edges(NULL)
     {
       uint64_t edge_data_total_size = 0;
       uint64_t total_system_memory = getTotalSystemMemory();
@@ -0,0 +1,282 @@
+/*
+  checkpoint.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef checkpoint_hpp
+#define checkpoint_hpp
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "graph_objects.hpp"
+#include "edge_tracker.hpp"
+#include "vertex_values.hpp"
+
+#define CHECKPOINT_INFO "checkpoint.info"
+
+namespace GraphSN {
+
+  /*
+      Checkpoints taken at iteration boundaries. Each one holds the scheduler, the iteration
+      counter and the vertex pages changed since the previous one; the full vertex values are
+      written again once the deltas add up to their size. Edge data is written in place during
+      an iteration, so instead of copying it the edge tracker keeps an undo log of the blocks
+      overwritten since the checkpoint. A checkpoint becomes the latest consistent one when
+      checkpoint.info is renamed over the previous one.
+
+      Files of checkpoint N: vertices_N, scheduler_N, edge_undo_N
+  */
+  template <typename VertexValue>
+  class Checkpoint{
+
+    std::string                   folder;
+    bool                          committed;
+    uint32_t                      number;         /* latest consistent checkpoint */
+    uint32_t                      base;           /* checkpoint that holds the full vertex values */
+    uint64_t                      delta_bytes;    /* bytes of vertex deltas written after base */
+    VertexValues<VertexValue> *   hValues;
+    GraphBox *                    hGraphbox;
+
+    std::string filename(std::string name, uint32_t checkpointID)
+    {
+      return folder + name + "_" + std::to_string(checkpointID);
+    }
+
+    /**
+     * write_file
+     *
+     * Writes a buffer to a new file and flushes it to disk
+     *
+     * @param   name      name of file
+     * @param   buffer    buffer to be written
+     * @param   bytes     number of bytes
+     * @return  void
+     */
+    static void write_file(std::string name, char * buffer, size_t bytes)
+    {
+      int32_t fd;
+
+      fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (fd == -1) handle_error(("opening " + name).c_str());
+      write_sys(buffer, bytes, fd);
+      if (fdatasync(fd) == -1) handle_error(("syncing " + name).c_str());
+      close(fd);
+    }
+
+    static std::vector<char> read_file(std::string name)
+    {
+      std::vector<char> buffer(GetFileSize(name));
+      int32_t fd;
+
+      fd = open(name.c_str(), O_RDONLY);
+      if (fd == -1) handle_error(("opening " + name).c_str());
+      read_sys(buffer.data(), buffer.size(), fd);
+      close(fd);
+      return buffer;
+    }
+
+    /**
+     * write_vertices
+     *
+     * Writes either the full vertex values or the pages changed since the previous checkpoint.
+     * A delta is a sequence of page IDs, each one followed by the page.
+     *
+     * @param   checkpointID    checkpoint
+     * @param   full            write every value
+     * @param   pages           changed pages
+     * @return  bytes written
+     */
+    size_t write_vertices(uint32_t checkpointID, bool full, std::vector<uint32_t>& pages)
+    {
+      std::vector<char> buffer;
+      size_t length;
+
+      if (full){
+        write_file(filename("vertices", checkpointID), reinterpret_cast<char*>(hValues->get(0)), hValues->bytes());
+        return hValues->bytes();
+      }
+      for (uint32_t i = 0; i < pages.size(); i++){
+        char * page = hValues->page(pages[i], length);
+        buffer.insert(buffer.end(), reinterpret_cast<char*>(&pages[i]), reinterpret_cast<char*>(&pages[i]) + sizeof(uint32_t));
+        buffer.insert(buffer.end(), page, page + length);
+      }
+      write_file(filename("vertices", checkpointID), buffer.data(), buffer.size());
+      return buffer.size();
+    }
+
+    void read_vertices(uint32_t checkpointID, bool full)
+    {
+      std::vector<char> buffer = read_file(filename("vertices", checkpointID));
+      size_t position = 0, length;
+
+      if (full){
+        CHECK(buffer.size() == hValues->bytes());
+        memcpy(hValues->get(0), buffer.data(), buffer.size());
+        return;
+      }
+      while (position < buffer.size()){
+        uint32_t pageID;
+        char * page;
+
+        memcpy(&pageID, &buffer[position], sizeof(uint32_t));
+        page = hValues->page(pageID, length);
+        memcpy(page, &buffer[position + sizeof(uint32_t)], length);
+        position += sizeof(uint32_t) + length;
+      }
+    }
+
+    /**
+     * commit
+     *
+     * Makes the checkpoint that has just been written the latest consistent one
+     *
+     * @return  void
+     */
+    void commit()
+    {
+      std::ofstream info;
+      std::string info_filename = folder + CHECKPOINT_INFO;
+      int32_t fd;
+
+      info.open((info_filename + ".tmp").c_str(), std::ofstream::trunc);
+      CHECK(info.is_open());
+      info << number << " " << base << " " << delta_bytes << " "
+           << hGraphbox->get_current_iteration() << " " << hGraphbox->get_iterations_num() << std::endl;
+      info.close();
+      fd = open((info_filename + ".tmp").c_str(), O_RDONLY);
+      if (fd == -1 || fdatasync(fd) == -1) handle_error(("syncing " + info_filename).c_str());
+      close(fd);
+      if (rename((info_filename + ".tmp").c_str(), info_filename.c_str()) == -1) handle_error(("renaming " + info_filename).c_str());
+      fd = open(folder.c_str(), O_RDONLY);
+      if (fd == -1 || fsync(fd) == -1) handle_error(("syncing " + folder).c_str());
+      close(fd);
+    }
+
+  public:
+
+    Checkpoint(std::string folder, VertexValues<VertexValue> * hValues, GraphBox * hGraphbox): folder(folder), committed(false),
+    number(0), base(0), delta_bytes(0), hValues(hValues), hGraphbox(hGraphbox)
+    {
+      check_directory(folder.c_str());
+    }
+
+    /**
+     * resume
+     *
+     * Restores the latest consistent checkpoint, if there is one: rolls the edge data files back,
+     * rebuilds the vertex values from the full values and the deltas that follow them, and
+     * restores the scheduler and the iteration counter.
+     *
+     * @return  true if a checkpoint was restored
+     */
+    bool resume()
+    {
+      std::ifstream info;
+      std::vector<char> scheduler_state;
+      uint32_t iteration, iterations_num, undone;
+
+      info.open((folder + CHECKPOINT_INFO).c_str());
+      if (!info.is_open()){
+        return false;
+      }
+      info >> number >> base >> delta_bytes >> iteration >> iterations_num;
+      CHECK(info);
+      info.close();
+
+      undone = edge_tracker.apply_undo_log(filename("edge_undo", number), edge_data_filename);
+      read_vertices(base, true);
+      for (uint32_t checkpointID = base + 1; checkpointID <= number; checkpointID++){
+        read_vertices(checkpointID, false);
+      }
+      hValues->restored();
+      scheduler_state = read_file(filename("scheduler", number));
+      hGraphbox->scheduler->deserialize(std::vector<uint8_t>(scheduler_state.begin(), scheduler_state.end()));
+      hGraphbox->set_current_iteration(iteration);
+      hGraphbox->set_last_iteration(iterations_num);
+      edge_tracker.open_undo_log(filename("edge_undo", number));
+      committed = true;
+      LOG("Resuming from checkpoint %u at iteration %u, %u edge data undo record(s) applied\n", number, iteration, undone);
+      return true;
+    }
+
+    /**
+     * save
+     *
+     * Takes a checkpoint. It must be called at an iteration boundary.
+     *
+     * @return  void
+     */
+    void save()
+    {
+      std::vector<uint32_t> pages;
+      std::vector<uint8_t> scheduler_state;
+      uint32_t checkpointID, previous_number = number, previous_base = base;
+      size_t delta_size;
+      bool full;
+
+      /* edge data written so far becomes part of the checkpoint */
+      edge_tracker.sync_files();
+      checkpointID = committed ? number + 1 : 0;
+      hValues->collect_checkpoint_pages(pages);
+      delta_size = pages.size() * (sizeof(uint32_t) + hValues->bytes() / std::max<uint32_t>(hValues->get_pages_num(), 1));
+      full = !committed || delta_bytes + delta_size >= hValues->bytes();
+      delta_size = write_vertices(checkpointID, full, pages);
+      scheduler_state = hGraphbox->scheduler->serialize();
+      write_file(filename("scheduler", checkpointID), reinterpret_cast<char*>(scheduler_state.data()), scheduler_state.size());
+
+      number = checkpointID;
+      if (full){
+        base = checkpointID;
+        delta_bytes = 0;
+      }
+      else{
+        delta_bytes += delta_size;
+      }
+      commit();
+      edge_tracker.open_undo_log(filename("edge_undo", checkpointID));
+      DBG_LOG("Checkpoint %u at iteration %u: %s, %lu vertex page(s) changed\n", checkpointID,
+              hGraphbox->get_current_iteration(), full ? "full" : "delta", pages.size());
+
+      /* files of the previous checkpoint are not needed anymore */
+      if (committed){
+        remove(filename("edge_undo", previous_number).c_str());
+        remove(filename("scheduler", previous_number).c_str());
+        if (full){
+          for (uint32_t i = previous_base; i <= previous_number; i++){
+            remove(filename("vertices", i).c_str());
+          }
+        }
+      }
+      committed = true;
+    }
+
+    /**
+     * finish
+     *
+     * Removes the checkpoint after a run that completed
+     *
+     * @return  void
+     */
+    void finish()
+    {
+      if (!committed){
+        return;
+      }
+      edge_tracker.close_undo_log();
+      remove((folder + CHECKPOINT_INFO).c_str());
+      remove(filename("edge_undo", number).c_str());
+      remove(filename("scheduler", number).c_str());
+      for (uint32_t i = base; i <= number; i++){
+        remove(filename("vertices", i).c_str());
+      }
+      committed = false;
+    }
+  };
+}
+
+#endif /* checkpoint_hpp */
@@ -10,54 +10,57 @@
 #include "timer.hpp"
 #include "preprocessing.hpp"
 #include "graph_engine.hpp"
+#include "streaming_engine.hpp"
 #include "scheduler.hpp"
 #include "metrics.hpp"
 
 using namespace GraphSN;
 
-value_t data_function(value_t data, value_t edge_data)
-{
-  SILENCE edge_data;
-  return data;
-}
+typedef vertex_t  VertexValue;  /* component label */
+typedef float     EdgeValue;    /* not used by the algorithm */
 
-class ExampleProgram : public GraphSNProgram{
+class ExampleProgram final : public GraphSNProgram<VertexValue, EdgeValue>{
   
-  bool converged;
+  Aggregator<bool, OrMonoid> * changed;
 
-  void update(GraphVertex& vertex, GraphBox& graphbox) {
-    graphbox.scheduler->remove_task(vertex.getID());
-    
+public:
+
+  void update(Vertex& vertex, GraphBox& graphbox) {
     if (graphbox.get_current_iteration() == 0) {
       vertex.setData(vertex.getID());
       graphbox.scheduler->add_task(vertex.getID());
     }
     
-    vertex_t curmin = vertex.getData();
-    for(uint32_t i = 0; i < vertex.num_edges(); i++) {
-      vertex_t nblabel = vertex.edge(i).getVertex()->getData();
-      if (graphbox.get_current_iteration() == 0){
-        nblabel = vertex.edge(i).getID();
+    vertex_t curmin = (graphbox.get_current_iteration() == 0) ? vertex.getID() : (vertex_t) vertex.getData();
+    for(uint32_t s = 0; s < vertex.edgeSpans(); s++) {
+      Span edges = vertex.edgeSpan(s);
+      for(uint32_t i = 0; i < edges.size(); i++) {
+        vertex_t nblabel = (graphbox.get_current_iteration() == 0) ? edges.getID(i) : edges.getVertex(i)->getData();
+        curmin = std::min(nblabel, curmin);
       }
-      curmin = std::min(nblabel, curmin);
     }
     
-    vertex.setData(curmin);
-    vertex_t label = vertex.getData();
+    vertex.minData(curmin);
+    vertex_t label = curmin;
     
     if (graphbox.get_current_iteration() > 0) {
-      for(uint32_t i = 0; i < vertex.num_edges(); i++) {
-        if (label < vertex.edge(i).getVertex()->getData()) {
-          vertex.edge(i).getVertex()->setData(label);
-          /* Schedule neighbor for update */
-          graphbox.scheduler->add_task(vertex.edge(i).getID(), true);
-          converged = false;
+      for(uint32_t s = 0; s < vertex.edgeSpans(); s++) {
+        Span edges = vertex.edgeSpan(s);
+        for(uint32_t i = 0; i < edges.size(); i++) {
+          if (edges.getVertex(i)->minData(label)) {
+            /* Schedule neighbor for update */
+            graphbox.scheduler->add_task(edges.getID(i), true);
+            changed->add(true);
+          }
         }
       }
     }
     else if (graphbox.get_current_iteration() == 0) {
-      for(uint32_t i = 0; i < vertex.getOutdegree(); i++) {
-        vertex.outedge(i).getVertex()->setData(label);
+      for(uint32_t s = 0; s < vertex.outedgeSpans(); s++) {
+        Span edges = vertex.outedgeSpan(s);
+        for(uint32_t i = 0; i < edges.size(); i++) {
+          edges.getVertex(i)->minData(label);
+        }
       }
     }
   }
@@ -66,14 +69,14 @@ class ExampleProgram : public GraphSNProgram{
    */
   void before_iteration(GraphBox& graphbox) {
     println("Start of iteration %u/%u",graphbox.get_current_iteration(), graphbox.get_iterations_num() - 1);
-    converged = graphbox.get_current_iteration() > 0;
+    changed = graphbox.or_aggregator("changed");
   }
   
   /**
    * Called after an iteration has finished.
    */
   void after_iteration(GraphBox& graphbox) {
-    if (converged) {
+    if (graphbox.get_current_iteration() > 0 && !changed->get()) {
       println("Last iteration set!");
       graphbox.set_last_iteration(graphbox.get_current_iteration());
     }
@@ -98,14 +101,74 @@ class ExampleProgram : public GraphSNProgram{
   
 };
 
+/*
+    Same labelling for the streaming engine: every scheduled vertex sends its label
+    along its edges in both directions, a vertex that receives a smaller one is scheduled.
+*/
+class StreamingComponents final : public GraphSNStreamingProgram<VertexValue, EdgeValue>{
+
+  Aggregator<bool, OrMonoid> * changed;
+
+public:
+
+  void initialize(Vertex& vertex, GraphBox& graphbox) {
+    SILENCE(graphbox);
+    vertex.setData(vertex.getID());
+  }
+
+  bool undirected() {
+    return true;
+  }
+
+  bool scatter(vertex_t src, VertexValue src_value, vertex_t dst, EdgeValue edge_data, VertexValue& update, GraphBox& graphbox) {
+    SILENCE(src); SILENCE(dst); SILENCE(edge_data); SILENCE(graphbox);
+    update = src_value;
+    return true;
+  }
+
+  void gather(Vertex& vertex, VertexValue update, GraphBox& graphbox) {
+    if (vertex.minData(update)) {
+      graphbox.scheduler->add_task(vertex.getID());
+      changed->add(true);
+    }
+  }
+
+  void before_iteration(GraphBox& graphbox) {
+    println("Start of iteration %u/%u",graphbox.get_current_iteration(), graphbox.get_iterations_num() - 1);
+    changed = graphbox.or_aggregator("changed");
+  }
+
+  void after_iteration(GraphBox& graphbox) {
+    if (!changed->get()) {
+      println("Last iteration set!");
+      graphbox.set_last_iteration(graphbox.get_current_iteration());
+    }
+    else{
+      println("End of iteration %u/%u\n",graphbox.get_current_iteration(), graphbox.get_iterations_num() - 1);
+    }
+  }
+
+  void before_exec_interval(GraphBox& graphbox) {
+    SILENCE(graphbox);
+  }
+
+  void after_exec_interval(GraphBox& graphbox) {
+    SILENCE(graphbox);
+  }
+
+};
+
 int main(int argc, const char * argv[]) {
   
   uint32_t iterations;
   uint64_t cache_size;
   ExampleProgram program;
-  Engine * engine;
-  Preprocessing hPreprocessing;
+  StreamingComponents streaming_program;
+  Engine<VertexValue, EdgeValue> * engine = NULL;
+  StreamingEngine<VertexValue, EdgeValue> * streaming_engine = NULL;
+  Preprocessing<VertexValue, EdgeValue> hPreprocessing;
   std::string cache_type = "LRU";
+  std::string engine_type = "PSW";    /* PSW | Streaming */
   
   timer.start("Main execution");
   iterations = 1000;
@@ -113,16 +176,27 @@ int main(int argc, const char * argv[]) {
 
   GraphSNInit(argc, argv);
   hPreprocessing.CheckPreprocessing(inFolder);
-  engine = new Engine();
-  engine->run(program, iterations, cache_size, cache_type);
+  if (engine_type == "PSW"){
+    engine = new Engine<VertexValue, EdgeValue>();
+    engine->run<ExampleProgram>(program, iterations, cache_size, cache_type);
+  }
+  else if (engine_type == "Streaming"){
+    streaming_engine = new StreamingEngine<VertexValue, EdgeValue>();
+    streaming_engine->run<StreamingComponents>(streaming_program, iterations);
+  }
+  else{
+    println("Unrecognized engine type");
+    exit(1);
+  }
   timer.end("Main execution");
 
   timer.start("metrics");
-  AnalyzeConnectedComponents(std::string(infile));
+  AnalyzeConnectedComponents<VertexValue>(std::string(infile));
   timer.end("metrics");
   
   timer.print_timing_report();
   
   delete engine;
+  delete streaming_engine;
   return 0;
 }
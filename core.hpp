@@ -16,14 +16,9 @@
 
 #include "log.hpp"
 #include "files.hpp"
+#include "task_runtime.hpp"
 #include "graph_program.hpp"
 
-#ifdef __APPLE__
-#include <libiomp/omp.h>
-#else
-#include <omp.h>
-#endif
-
 namespace GraphSN {
 
   /* variables */
@@ -77,5 +72,6 @@ namespace GraphSN {
 
     /*required calls for setup*/
     InitRequiredDirectories(inFolder);
+    runtime.start(number_of_cores);
   }
 }
@@ -0,0 +1,480 @@
+/*
+  edge_tracker.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef edge_tracker_hpp
+#define edge_tracker_hpp
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "files.hpp"
+#include "task_runtime.hpp"
+
+#define EDGE_DIRTY_BLOCK_SIZE (4L*1024L)  /* bytes of an edge data file covered by one dirty flag */
+
+namespace GraphSN {
+
+  /* edge data of a shard that is currently in memory */
+  typedef struct EdgeWindow_s{
+    int16_t     shardID;
+    char *      data;
+    uint32_t    elements;
+    uint32_t    first_edge;   /* position of data[0] in the edge data file */
+    uint8_t *   dirty;        /* one flag for every block of the file that the window touches */
+    std::string filename;
+  }EdgeWindow_t;
+
+  /* modified edge data staged for writing */
+  typedef struct DirtyRange_s{
+    int16_t     shardID;
+    uint32_t    first_edge;
+    uint32_t    elements;
+    char *      data;
+    std::string filename;
+  }DirtyRange_t;
+
+  /* header of a pre-image in the undo log, followed by the edge values */
+  typedef struct EdgeUndoRecord_s{
+    int16_t     shardID;
+    uint32_t    first_edge;
+    uint32_t    elements;
+  }EdgeUndoRecord_t;
+
+  /*
+      Keeps track of the edge data windows loaded by the shards and of the blocks
+      modified through GraphEdge::setData. Dirty blocks are staged and written back
+      asynchronously, clean windows are never written.
+      While an undo log is open, the previous contents of every block are appended to it
+      before the block is overwritten for the first time, so that the edge data files can
+      be rolled back to the last checkpoint.
+      Edge values are handled as value_size bytes, the width of the engine's edge type.
+  */
+  class EdgeDataTracker{
+
+    std::vector <EdgeWindow_t>  windows;
+    TaskGroup *                 writes;
+    int32_t                     undo_fd;
+    std::mutex                  undo_mtx;
+    std::map <int16_t, std::vector <uint8_t> > logged;   /* blocks of every file already in the undo log */
+    std::set <std::string>      written_files;
+    size_t                      value_size;
+
+    uint32_t block_of(uint32_t edge)
+    {
+      return (uint32_t) ((uint64_t) edge * value_size / EDGE_DIRTY_BLOCK_SIZE);
+    }
+
+    /* first edge that starts in the block */
+    uint32_t first_edge_of(uint32_t block)
+    {
+      return (uint32_t) (((uint64_t) block * EDGE_DIRTY_BLOCK_SIZE + value_size - 1) / value_size);
+    }
+
+    /**
+     * log_blocks
+     *
+     * Appends the on-disk contents of the blocks touched by a range that are not in the undo log yet
+     *
+     * @param   range           range about to be written
+     * @param   fd              edge data file
+     * @param   file_edges      number of edges in the file
+     * @param   logged_blocks   blocks of the file already in the undo log
+     * @return  true if something was appended
+     */
+    bool log_blocks(DirtyRange_t& range, int32_t fd, uint32_t file_edges, std::vector <uint8_t>& logged_blocks)
+    {
+      uint32_t block = block_of(range.first_edge);
+      uint32_t last_block = block_of(range.first_edge + range.elements - 1);
+      bool appended = false;
+
+      if (logged_blocks.size() <= last_block){
+        logged_blocks.resize(block_of(file_edges - 1) + 1, 0);
+      }
+      while (block <= last_block){
+        uint32_t run_end = block;
+        EdgeUndoRecord_t record;
+        char * preimage;
+
+        if (logged_blocks[block]){
+          block++;
+          continue;
+        }
+        while (run_end <= last_block && !logged_blocks[run_end]){
+          logged_blocks[run_end] = 1;
+          run_end++;
+        }
+        /* whole blocks are logged, a later window may overwrite the rest of them */
+        record.shardID    = range.shardID;
+        record.first_edge = first_edge_of(block);
+        record.elements   = std::min(first_edge_of(run_end), file_edges) - record.first_edge;
+        preimage = (char *) malloc(record.elements * value_size);
+        pread_sys(preimage, record.elements * value_size, (off_t) record.first_edge * value_size, fd);
+        {
+          std::lock_guard<std::mutex> lock(undo_mtx);
+          write_sys(reinterpret_cast<char*>(&record), sizeof(EdgeUndoRecord_t), undo_fd);
+          write_sys(preimage, record.elements * value_size, undo_fd);
+        }
+        free(preimage);
+        appended = true;
+        block = run_end;
+      }
+      return appended;
+    }
+
+    /**
+     * write_ranges
+     *
+     * Write staged ranges of one file to disk
+     *
+     * @param   ranges          ranges of the same file, ordered by offset
+     * @param   logged_blocks   blocks of the file already in the undo log
+     * @return  void
+     */
+    void write_ranges(std::vector <DirtyRange_t> ranges, std::vector <uint8_t> * logged_blocks)
+    {
+      int32_t fd;
+
+      fd = open(ranges[0].filename.c_str(), O_RDWR);
+      if (fd == -1) handle_error(("opening " + ranges[0].filename).c_str());
+      if (undo_fd != -1){
+        uint32_t file_edges = GetElementsNumber(ranges[0].filename, value_size);
+        bool appended = false;
+
+        for (uint32_t i = 0; i < ranges.size(); i++){
+          appended |= log_blocks(ranges[i], fd, file_edges, *logged_blocks);
+        }
+        /* the undo log has to reach the disk before the blocks are overwritten */
+        if (appended && fdatasync(undo_fd) == -1) handle_error("syncing undo log");
+      }
+      for (uint32_t i = 0; i < ranges.size(); i++){
+        pwrite_sys(ranges[i].data, ranges[i].elements * value_size, (off_t) ranges[i].first_edge * value_size, fd);
+        free(ranges[i].data);
+      }
+      close(fd);
+    }
+
+  public:
+
+    EdgeDataTracker(): writes(NULL), undo_fd(-1), value_size(sizeof(value_t)){}
+
+    ~EdgeDataTracker()
+    {
+      wait();
+      clear();
+      close_undo_log();
+      delete writes;
+    }
+
+    /**
+     * set_value_size
+     *
+     * Sets the width of the edge values, before any window is added
+     *
+     * @param   value_size    bytes of an edge value
+     * @return  void
+     */
+    void set_value_size(size_t value_size)
+    {
+      CHECK(windows.empty());
+      this->value_size = value_size;
+    }
+
+    /**
+     * add_window
+     *
+     * Start tracking the edge data that a shard loaded in memory
+     *
+     * @param   shardID       shardID
+     * @param   data          loaded edge data
+     * @param   elements      number of loaded edges
+     * @param   first_edge    position of the first loaded edge in the edge data file
+     * @param   filename      edge data file
+     * @return  void
+     */
+    template <typename EdgeValue>
+    void add_window(int16_t shardID, EdgeValue * data, uint32_t elements, uint32_t first_edge, std::string filename)
+    {
+      EdgeWindow_t window;
+      std::vector <EdgeWindow_t>::iterator it;
+
+      CHECK(sizeof(EdgeValue) == value_size);
+      if (elements == 0){
+        return;
+      }
+      window.shardID    = shardID;
+      window.data       = reinterpret_cast<char*>(data);
+      window.elements   = elements;
+      window.first_edge = first_edge;
+      window.dirty      = (uint8_t *) calloc(block_of(first_edge + elements - 1) - block_of(first_edge) + 1, sizeof(uint8_t));
+      window.filename   = filename;
+      /* windows are kept sorted by address, so that mark_dirty can use binary search */
+      for (it = windows.begin(); it != windows.end(); ++it){
+        if (it->data > window.data){
+          break;
+        }
+      }
+      windows.insert(it, window);
+    }
+
+    /**
+     * clear
+     *
+     * Stop tracking every window. Dirty blocks that have not been collected are lost.
+     *
+     * @return  void
+     */
+    void clear()
+    {
+      for (uint32_t i = 0; i < windows.size(); i++){
+        free(windows[i].dirty);
+      }
+      windows.clear();
+    }
+
+    /**
+     * mark_dirty
+     *
+     * Marks the block that contains an edge value as modified
+     *
+     * @param   value   address of the modified edge value
+     * @return  void
+     */
+    template <typename EdgeValue>
+    void mark_dirty(EdgeValue * value)
+    {
+      char * address = reinterpret_cast<char*>(value);
+      int32_t low = 0, high = (int32_t) windows.size() - 1;
+
+      while (low <= high){
+        int32_t middle = (low + high) / 2;
+        EdgeWindow_t& window = windows[middle];
+
+        if (address < window.data){
+          high = middle - 1;
+        }
+        else if (address >= window.data + (size_t) window.elements * value_size){
+          low = middle + 1;
+        }
+        else{
+          uint32_t edge = window.first_edge + (uint32_t) ((address - window.data) / value_size);
+          __atomic_store_n(&window.dirty[block_of(edge) - block_of(window.first_edge)], 1, __ATOMIC_RELAXED);
+          return;
+        }
+      }
+    }
+
+    /**
+     * collect
+     *
+     * Stages the modified parts of every window and clears their dirty flags.
+     * Consecutive dirty blocks are merged into a single range.
+     *
+     * @return  staged ranges, ordered by window
+     */
+    std::vector <DirtyRange_t> collect()
+    {
+      std::vector <DirtyRange_t> ranges;
+
+      for (uint32_t w = 0; w < windows.size(); w++){
+        EdgeWindow_t& window = windows[w];
+        uint32_t first_block = block_of(window.first_edge);
+        uint32_t last_block = block_of(window.first_edge + window.elements - 1);
+        uint32_t block = first_block;
+
+        while (block <= last_block){
+          uint32_t run_end, first, last;
+          DirtyRange_t range;
+
+          if (!window.dirty[block - first_block]){
+            block++;
+            continue;
+          }
+          run_end = block;
+          while (run_end <= last_block && window.dirty[run_end - first_block]){
+            window.dirty[run_end - first_block] = 0;
+            run_end++;
+          }
+          first = std::max(first_edge_of(block), window.first_edge);
+          last = std::min(first_edge_of(run_end), window.first_edge + window.elements);
+
+          range.shardID    = window.shardID;
+          range.first_edge = first;
+          range.elements   = last - first;
+          range.data       = (char *) malloc(range.elements * value_size);
+          range.filename   = window.filename;
+          memcpy(range.data, &window.data[(size_t) (first - window.first_edge) * value_size], range.elements * value_size);
+          ranges.push_back(range);
+          block = run_end;
+        }
+      }
+      return ranges;
+    }
+
+    /**
+     * write
+     *
+     * Writes staged ranges to their edge data files in the background, one task per file.
+     * Writes scheduled by a previous call are finished first.
+     *
+     * @param   ranges    ranges returned by collect
+     * @return  void
+     */
+    void write(std::vector <DirtyRange_t>& ranges)
+    {
+      uint32_t first = 0;
+
+      if (ranges.empty()){
+        return;
+      }
+      /* writes of the previous interval may target the same blocks */
+      wait();
+      if (!writes){
+        writes = new TaskGroup();
+      }
+      while (first < ranges.size()){
+        uint32_t last = first;
+        while (last < ranges.size() && ranges[last].filename == ranges[first].filename){
+          last++;
+        }
+        std::vector <DirtyRange_t> file_ranges(ranges.begin() + first, ranges.begin() + last);
+        std::vector <uint8_t> * logged_blocks = &logged[ranges[first].shardID];
+        written_files.insert(ranges[first].filename);
+        writes->run([this, file_ranges, logged_blocks](){
+          write_ranges(file_ranges, logged_blocks);
+        });
+        first = last;
+      }
+      DBG_LOG("%lu dirty edge range(s) scheduled for writing\n", ranges.size());
+    }
+
+    /**
+     * wait
+     *
+     * Waits for every scheduled write
+     *
+     * @return  void
+     */
+    void wait()
+    {
+      if (writes){
+        writes->wait();
+      }
+    }
+
+    /**
+     * sync_files
+     *
+     * Waits for every scheduled write and flushes the edge data files written since the last call
+     *
+     * @return  void
+     */
+    void sync_files()
+    {
+      wait();
+      for (std::set <std::string>::iterator it = written_files.begin(); it != written_files.end(); ++it){
+        int32_t fd = open(it->c_str(), O_RDONLY);
+        if (fd == -1) handle_error(("opening " + *it).c_str());
+        if (fdatasync(fd) == -1) handle_error(("syncing " + *it).c_str());
+        close(fd);
+      }
+      written_files.clear();
+    }
+
+    /**
+     * open_undo_log
+     *
+     * Starts a new, empty undo log. Every block is logged again before its next write.
+     *
+     * @param   undo_filename   undo log file
+     * @return  void
+     */
+    void open_undo_log(std::string undo_filename)
+    {
+      wait();
+      close_undo_log();
+      undo_fd = open(undo_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (undo_fd == -1) handle_error(("opening " + undo_filename).c_str());
+    }
+
+    void close_undo_log()
+    {
+      if (undo_fd != -1){
+        close(undo_fd);
+        undo_fd = -1;
+      }
+      logged.clear();
+    }
+
+    /**
+     * apply_undo_log
+     *
+     * Rolls the edge data files back to the contents they had when the undo log was opened.
+     * A record cut short by a crash is ignored, its blocks were never overwritten.
+     *
+     * @param   undo_filename   undo log file
+     * @param   edata_filename  prefix of the edge data files
+     * @return  number of records applied
+     */
+    uint32_t apply_undo_log(std::string undo_filename, std::string edata_filename)
+    {
+      std::vector <char> log;
+      std::vector <size_t> records;
+      std::set <int16_t> shards;
+      size_t position = 0;
+      int32_t fd;
+
+      if (!check_file(undo_filename)){
+        return 0;
+      }
+      log.resize(GetFileSize(undo_filename));
+      fd = open(undo_filename.c_str(), O_RDONLY);
+      if (fd == -1) handle_error(("opening " + undo_filename).c_str());
+      read_sys(log.data(), log.size(), fd);
+      close(fd);
+      while (position + sizeof(EdgeUndoRecord_t) <= log.size()){
+        EdgeUndoRecord_t * record = reinterpret_cast<EdgeUndoRecord_t *>(&log[position]);
+        size_t record_bytes = sizeof(EdgeUndoRecord_t) + record->elements * value_size;
+
+        if (position + record_bytes > log.size()){
+          break;
+        }
+        records.push_back(position);
+        position += record_bytes;
+      }
+      /* the oldest pre-image of a block is the one of the checkpoint, so it is applied last */
+      for (size_t i = records.size(); i-- > 0;){
+        EdgeUndoRecord_t * record = reinterpret_cast<EdgeUndoRecord_t *>(&log[records[i]]);
+        std::string filename = edata_filename + std::to_string(record->shardID);
+
+        fd = open(filename.c_str(), O_WRONLY);
+        if (fd == -1) handle_error(("opening " + filename).c_str());
+        pwrite_sys(&log[records[i] + sizeof(EdgeUndoRecord_t)], record->elements * value_size,
+                   (off_t) record->first_edge * value_size, fd);
+        close(fd);
+        shards.insert(record->shardID);
+      }
+      for (std::set <int16_t>::iterator it = shards.begin(); it != shards.end(); ++it){
+        std::string filename = edata_filename + std::to_string(*it);
+
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) handle_error(("opening " + filename).c_str());
+        if (fdatasync(fd) == -1) handle_error(("syncing " + filename).c_str());
+        close(fd);
+      }
+      return (uint32_t) records.size();
+    }
+  };
+
+  EdgeDataTracker edge_tracker;
+}
+
+#endif /* edge_tracker_hpp */
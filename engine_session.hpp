@@ -0,0 +1,33 @@
+/*
+  engine_session.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef engine_session_hpp
+#define engine_session_hpp
+
+#include "graph_engine.hpp"
+
+namespace GraphSN {
+  
+  /*
+      Engine that stays loaded between runs. The outbound indices, the vertices, the shards
+      kept in memory and the edge data cache (if the next run asks for the same one) are kept,
+      so only the first run pays for loading them. The vertex values stay loaded too: every
+      run starts from those the previous one saved to vertex_data, or from the initial ones
+      if the runs don't save theirs, with a new scheduler and aggregators.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class EngineSession: public Engine<VertexValue, EdgeValue>{
+    
+  public:
+    
+    EngineSession(): Engine<VertexValue, EdgeValue>()
+    {
+      this->session = true;
+    }
+  };
+}
+
+#endif /* engine_session_hpp */
@@ -12,7 +12,6 @@
 #include <cstring>
 #include <vector>
 #include <algorithm>
-#include <thread>
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -114,13 +113,14 @@ namespace GraphSN {
     }
   };
   
-  template <typename EdgeType>
+  /* VertexValue and EdgeValue are the types of the vertex and edge data files written by the sharder */
+  template <typename EdgeType, typename VertexValue, typename EdgeValue>
   class kway
   {
     
     typedef struct chunks
     {
-      std::thread * cthreads;
+      TaskGroup * sort_tasks;
       EdgeType ** thread_chunk;
       int active_threads;
       
@@ -136,7 +136,7 @@ namespace GraphSN {
       
       void init_chunks(int size)
       {
-        cthreads = new std::thread[NUMBER_OF_THREADS];
+        sort_tasks = new TaskGroup();
         thread_chunk = (EdgeType**) malloc(NUMBER_OF_THREADS*sizeof(EdgeType *));
         for (int i = 0;i < NUMBER_OF_THREADS; i++){
           thread_chunk[i] = (EdgeType*) malloc(size*sizeof(EdgeType));
@@ -147,7 +147,7 @@ namespace GraphSN {
       void destroy_chunks()
       {
         int i;
-        delete[] cthreads;
+        delete sort_tasks;
         for(i = 0; i < NUMBER_OF_THREADS; i++)
           free(thread_chunk[i]);
         free(thread_chunk);
@@ -356,7 +356,7 @@ namespace GraphSN {
       free(cur_block[1]);
       
       timer.end("MergeSort");
-      CalculateIntervals(tapes[outp][0]);
+      CalculateIntervals<EdgeType, VertexValue, EdgeValue>(tapes[outp][0]);
       tapes[outp][0].shrink_to_fit();
       tapes[outp].shrink_to_fit();
       return;
@@ -375,19 +375,23 @@ namespace GraphSN {
     
     void add_chunk()
     {
-      int i,thid;
+      int thid;
       if (ch->active_threads == NUMBER_OF_THREADS)
       {
-        for (i = 0; i < NUMBER_OF_THREADS;i++){
-          ch->cthreads[i].join();
-          LOG("Chunk thread %d joined\n",i);
-        }
+        /* every chunk buffer is in use, wait for their sorts before reusing them */
+        ch->sort_tasks->wait();
+        LOG("Chunk sorts finished\n");
         ch->active_threads = 0;
       }
       thid = ch->active_threads;
       memmove(ch->thread_chunk[thid],chunk_array,chunk_size[thid]*sizeof(EdgeType));
       
-      ch->cthreads[thid] = std::thread(sort_chunk,ch->thread_chunk[thid],chunk_size[thid],fd[thid]);
+      EdgeType * edges_chunk = ch->thread_chunk[thid];
+      uint32_t size = chunk_size[thid];
+      uint32_t chunk_fd = fd[thid];
+      ch->sort_tasks->run([edges_chunk, size, chunk_fd](){
+        sort_chunk(edges_chunk, size, chunk_fd);
+      });
       edges_num += chunk_size[thid];
 
       chunk_size[thid] = 0;
@@ -423,10 +427,8 @@ namespace GraphSN {
     
     void endFirstPhase()
     {
-      for (int i = 0; i < ch->active_threads;i++){
-        ch->cthreads[i].join();
-        LOG("Chunk thread %d joined\n",i);
-      }
+      ch->sort_tasks->wait();
+      LOG("Chunk sorts finished\n");
       timer.start("MergeSort");
       mergesort();
     }
@@ -245,15 +245,16 @@ inline bool ModificationTimeCompare(const char * first, const char * second)
  * @param   filename      name of file
  * @param   bytes         number of bytes
  * @param   offset        offset parameter of memory mapping
+ * @param   shared        writes reach the file, otherwise they stay in private copies of the pages
  * @return  memory mapped buffer
  */
-inline void * CreateMmap(int32_t& fd, std::string filename, size_t bytes, off_t offset)
+inline void * CreateMmap(int32_t& fd, std::string filename, size_t bytes, off_t offset, bool shared = true)
 {
   void * buffer;
   
   fd = open(filename.c_str(), O_RDWR);
   if (fd == -1) handle_error(("opening "+ filename).c_str());
-  buffer = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+  buffer = mmap(NULL, bytes, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, offset);
   if (buffer == MAP_FAILED)  handle_error(("memory mapping " + filename).c_str());
   return buffer;
 }
@@ -298,10 +299,11 @@ inline void * CreateFixedMmap(int32_t& fd, std::string filename, int32_t number_
  * @param   fixed_start   the adjusted start of the memory mapping
  * @param   offset        offset parameter of memory mapping
  * @param   element_size  single element size
+ * @param   shared        writes reach the file, otherwise they stay in private copies of the pages
  * @return  memory mapped buffer
  */
 inline void * CreateFixedMmap(int32_t& fd, std::string filename, int32_t& number_of_elements,
-                              off_t offset, uint16_t& fixed_start, size_t element_size)
+                              off_t offset, uint16_t& fixed_start, size_t element_size, bool shared = true)
 {
   int pagesize;
   /* we need to check if "offset" is multiple of the page size. If it's not, then we have to adjust it */
@@ -312,7 +314,7 @@ inline void * CreateFixedMmap(int32_t& fd, std::string filename, int32_t& number
     fixed_start /= element_size;
     number_of_elements += fixed_start;
   }
-  return CreateMmap(fd, filename, number_of_elements * element_size, offset);
+  return CreateMmap(fd, filename, number_of_elements * element_size, offset, shared);
 }
 
 /**
@@ -335,6 +337,107 @@ inline void DestroyMmap(int32_t& fd, std::string filename, void * buffer, size_t
   close(fd);
 }
 
+/* window of a file mapped by a shard */
+typedef struct MappedWindow_s{
+  int32_t     fd;
+  void *      buffer;     /* start of the mapping, at a page boundary */
+  size_t      bytes;
+  std::string filename;
+}MappedWindow_t;
+
+/**
+ * UnmapWindow
+ *
+ * @param   window        mapped window, may be unmapped already
+ * @return  void
+ */
+inline void UnmapWindow(MappedWindow_t& window)
+{
+  if (window.buffer){
+    DestroyMmap(window.fd, window.filename, window.buffer, window.bytes, false);
+    window.buffer = NULL;
+  }
+}
+
+/**
+ * MapWindow
+ *
+ * maps privately the elements [first_element, first_element + number_of_elements) of a file,
+ * in place of the previous window. The kernel is asked to read the window ahead.
+ *
+ * @param   window              mapped window
+ * @param   filename            name of file
+ * @param   number_of_elements  elements of the window
+ * @param   first_element       first element of the window in the file
+ * @param   advice              access pattern of the window, e.g. MADV_SEQUENTIAL
+ * @return  first element of the window
+ */
+template <typename T>
+inline T * MapWindow(MappedWindow_t& window, std::string filename, int32_t number_of_elements, uint64_t first_element, int advice)
+{
+  uint16_t fixed_start = 0;
+  
+  UnmapWindow(window);
+  if (number_of_elements == 0){
+    return NULL;
+  }
+  window.buffer = CreateFixedMmap(window.fd, filename, number_of_elements, (off_t) (first_element * sizeof(T)), fixed_start, sizeof(T), false);
+  window.bytes = number_of_elements * sizeof(T);
+  window.filename = filename;
+  madvise(window.buffer, window.bytes, advice);
+  madvise(window.buffer, window.bytes, MADV_WILLNEED);
+  return reinterpret_cast<T *>(window.buffer) + fixed_start;
+}
+
+/**
+ * CreateReadOnlyMmap
+ *
+ * maps a whole file for reading, its pages are read from disk when they are first accessed
+ *
+ * @param   filename      name of file
+ * @param   bytes         number of bytes
+ * @return  memory mapped buffer, NULL if the file is empty
+ */
+inline void * CreateReadOnlyMmap(std::string filename, size_t bytes)
+{
+  int32_t fd;
+  void * buffer;
+
+  if (bytes == 0){
+    return NULL;
+  }
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) handle_error(("opening "+ filename).c_str());
+  buffer = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (buffer == MAP_FAILED)  handle_error(("memory mapping " + filename).c_str());
+  close(fd);
+  return buffer;
+}
+
+/**
+ * PrefetchMmap
+ *
+ * reads ahead a part of a memory mapping and faults its pages in
+ *
+ * @param   buffer        page aligned start of the part
+ * @param   bytes         number of bytes
+ * @return  void
+ */
+inline void PrefetchMmap(const char * buffer, size_t bytes)
+{
+  size_t pagesize = getpagesize();
+  volatile char touched;
+
+  if (bytes == 0){
+    return;
+  }
+  madvise(const_cast<char *>(buffer), bytes, MADV_WILLNEED);
+  for (size_t offset = 0; offset < bytes; offset += pagesize){
+    touched = buffer[offset];
+  }
+  (void) touched;
+}
+
 
 
 
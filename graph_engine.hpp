@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <fstream>
+#include <numeric>
 #include <iostream>
 #include <algorithm>
 
@@ -16,28 +17,80 @@
 #include "memoryshard.hpp"
 #include "slidingshard.hpp"
 #include "cache.hpp"
+#include "checkpoint.hpp"
+#include "graph_info.hpp"
+#include "memory_governor.hpp"
 
 #define KEEP_VERTICES true
+#define MMAP_VERTICES false   /* map vertex_data instead of reading it in memory */
+#define CHECKPOINT_ITERATIONS 0   /* iterations between checkpoints, 0 disables them */
+#define SYNCHRONOUS_EXECUTION false   /* updates read the values of the previous iteration */
+#define RESIDENT_GRAPH false    /* build the CSR of the whole graph once and keep it across iterations */
+#define CONCURRENT_INTERVALS 1  /* intervals executed together, 0 for as many as the memory budget holds */
+#define MEMORY_BUDGET 0         /* bytes the engine may use, 0 for three quarters of the physical memory */
+#define MMAP_SHARDS false       /* map the windows of the shards instead of reading them, the page cache replaces the edge data cache */
+#define LAZY_STARTUP false      /* map the graph files and read them in the background, instead of before the first run */
+#define PREFETCH_CHUNK_BYTES (4L*1024L*1024L)   /* bytes of a mapped file read by one background task */
 
 namespace GraphSN {
   
+  /*
+      VertexValue and EdgeValue are the types of the values in vertex_data and in the edge
+      data files, which have to be preprocessed with the same types.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
   class Engine{
     
+    typedef GraphVertex<VertexValue, EdgeValue>     Vertex;
+    typedef VertexStore<VertexValue, EdgeValue>     Store;
+    typedef GraphSNProgram<VertexValue, EdgeValue>  Program;
+    typedef Memoryshard<VertexValue, EdgeValue>     Memshard;
+    typedef Slidingshard<VertexValue, EdgeValue>    Slidshard;
+    typedef IntervalEdges<VertexValue, EdgeValue>   Edges;
+    
+    /* program of a batch, with its own vertex values, scheduler and iterations */
+    template <typename UserProgram>
+    struct Lane_t{
+      UserProgram *               program;
+      VertexValues<VertexValue> * values;
+      Store *                     store;
+      GraphBox *                  graphbox;
+      bool                        active;
+    };
+    
     bool                        keep_vertices_in_memory;
-    int32_t                     fd_vertices;
+    bool                        mmap_vertices;
+    bool                        mmap_shards;
+    bool                        lazy_startup;
+    bool                        synchronous;
+    bool                        resident;
+    uint16_t                    concurrent_intervals;
+    uint32_t                    checkpoint_iterations;
     uint32_t                    current_minID, current_maxID, current_vertices_num;
-    value_t *                   vertices_data_arr;
+    VertexValues<VertexValue> * vertex_values;
     std::vector < uint32_t >    intervals_edges;
     std::vector < Interval_t >  intervals;
+    std::vector < uint32_t >    sources_num;    /* number of outbound indices of every interval */
+    std::vector < uint16_t >    group_bounds;   /* group g executes the intervals group_bounds[g] to group_bounds[g + 1] - 1 */
+    uint64_t                    group_bytes;    /* reserved for the largest group */
+    uint64_t                    resident_bytes;
+    bool                        resident_loaded;  /* the resident graph is kept for the next run of a session */
+    MemoryGovernor              governor;
     Outbound_t **               outbound_indices_arr;
-    GraphSNProgram *         program;
-    Memoryshard *               memshard;
-    Slidingshard **             slidshard;
-    GraphVertex *               vertices;
+    Memshard *                  memshard;
+    Slidshard **                slidshard;
+    Store *                     store;
+    Edges *                     hEdges;
+    EdgeValue *                 group_edge_data;      /* edge values of the shards of an interval group */
+    vertex_t *                  group_adj;            /* destinations of the shards of a group, if shards are not kept in memory */
+    DegreeData_t *              group_degrees;
     GraphBox *                  hGraphbox;
     std::string                 vertices_filename;
     Cache *                     hCache;
-    Locks *                     hLocks;
+    uint64_t                    requested_cache_size, cache_bytes;
+    std::string                 cache_type;
+    Checkpoint<VertexValue> *   hCheckpoint;
+    TaskGroup *                 prefetches;   /* background reads of the mapped files */
 #ifdef KEEP_VERTICES
     vertex_t **                 adj_shard_arr;
     DegreeData_t *              inbound_degrees_arr;
@@ -48,59 +101,75 @@ namespace GraphSN {
       println("\n");
       for (uint32_t i = current_minID; i <= current_maxID; i++){
         uint32_t eID;
-        GraphVertex * vertex = &vertices[i];
-        println("Vertice %u with data %f\nInedges: %u", vertex->getID(), vertex->getData(), vertex->getIndegree());
-        for (eID = 0; eID < vertex->getIndegree(); eID++){
-          println("[%u -> %u, %f]", vertex->edge(eID).getID(), vertex->getID(), vertex->edge(eID).getData());
+        Vertex vertex(i, store);
+        println("Vertice %u with data %f\nInedges: %u", vertex.getID(), (double) vertex.getData(), vertex.getIndegree());
+        for (eID = 0; eID < vertex.getIndegree(); eID++){
+          println("[%u -> %u, %f]", vertex.edge(eID).getID(), vertex.getID(), (double) vertex.edge(eID).getData());
         }
-        println("Outedges: %u", vertex->getOutdegree());
-        for (; eID < vertex->getIndegree() + vertex->getOutdegree(); eID++){
-          println("[%u -> %u, %f]",vertex->getID(), vertex->edge(eID).getID(), vertex->edge(eID).getData());
+        println("Outedges: %u", vertex.getOutdegree());
+        for (; eID < vertex.getIndegree() + vertex.getOutdegree(); eID++){
+          println("[%u -> %u, %f]",vertex.getID(), vertex.edge(eID).getID(), (double) vertex.edge(eID).getData());
         }
         print("\n");
       }
     }
     
     
-    void load_shards_info()
+    /**
+     * prefetch
+     *
+     * Reads a mapped array in the background, in parts of PREFETCH_CHUNK_BYTES
+     *
+     * @param   data    mapped array
+     * @param   bytes   bytes of the array
+     * @return  void
+     */
+    void prefetch(const void * data, uint64_t bytes)
     {
-      std::fstream infoshard_file;
-      
-      infoshard_file.open(inFolder + "shards.info",std::fstream::binary | std::fstream::in);
-      CHECK(infoshard_file.is_open());
-      infoshard_file >> intervals_number >> edges_num >> vertices_number;
-      infoshard_file.close();
-      
-      DBG_LOG("Number of shards = %u\n", intervals_number);
-      DBG_LOG("Number of edges = %llu\n", (unsigned long long) edges_num);
-      DBG_LOG("Number of vertices = %u\n", vertices_number);
+      if (!prefetches){
+        prefetches = new TaskGroup();
+      }
+      for (uint64_t offset = 0; offset < bytes; offset += PREFETCH_CHUNK_BYTES){
+        const char * chunk = (const char *) data + offset;
+        uint64_t chunk_bytes = std::min<uint64_t>(PREFETCH_CHUNK_BYTES, bytes - offset);
+        
+        prefetches->run([chunk, chunk_bytes](){
+          PrefetchMmap(chunk, chunk_bytes);
+        });
+      }
     }
     
-    void load_intervals()
+    /**
+     * load_array
+     *
+     * Reads a file in memory, or maps it and reads it in the background in lazy start-up mode
+     *
+     * @param   filename    name of the file
+     * @param   bytes       bytes of the file
+     * @return  the array
+     */
+    void * load_array(std::string filename, uint64_t bytes)
     {
-      std::ifstream intervals_filestream;
-      std::string intervals_filename = inFolder + "intervals.binary";
+      void * data;
       
-      intervals_filestream.open(intervals_filename.c_str(),std::fstream::binary | std::fstream::in);
-      if (!intervals_filestream.is_open()) handle_error(("opening " + intervals_filename).c_str());
-      intervals.resize(intervals_number);
-      intervals_filestream.read(reinterpret_cast<char*>(&intervals[0]),intervals_number * sizeof(Interval_t));
-      CHECK(intervals_filestream);
-      intervals_filestream.close();
-      for (uint32_t i = 0; i < intervals_number; i++){
-        DBG_LOG("Interval %u in [%u,%u]\n", i, intervals[i].first_vid, intervals[i].last_vid);
+      if (lazy_startup){
+        data = CreateReadOnlyMmap(filename, bytes);
+        prefetch(data, bytes);
+        return data;
       }
+      data = allocate_array(bytes);
+      io().read(filename, data, bytes, 0);
+      return data;
     }
     
-    void load_intervals_edges()
+    void release_array(void * data, uint64_t bytes)
     {
-      std::fstream intervals_edges_file;
-      
-      intervals_edges_file.open(inFolder+"intervals_edges.binary",std::fstream::binary | std::fstream::in);
-      CHECK(intervals_edges_file.is_open());
-      intervals_edges.resize(intervals_number);
-      intervals_edges_file.read(reinterpret_cast <char*>(&intervals_edges[0]), intervals_number * sizeof(uint32_t));
-      intervals_edges_file.close();
+      if (!lazy_startup){
+        free(data);
+      }
+      else if (data && munmap(data, bytes) == -1){
+        handle_error("unmapping graph file");
+      }
     }
     
     /**
@@ -112,57 +181,66 @@ namespace GraphSN {
      */
     void preload_outbound_indices()
     {
-      FILE * pFile;
       uint32_t number_of_vertices;
       std::string outbound_filename = inFolder+"Outbound/outbound_indices_";
       
       outbound_indices_arr = (Outbound_t **) malloc(intervals_number * sizeof(Outbound_t *));
       /* load sources */
       for (int16_t interval = 0; interval < intervals_number; interval++){
-        pFile = fopen((outbound_filename + std::to_string(interval)+".binary").c_str(), "rb");
-        if (pFile == NULL) handle_error((outbound_filename + std::to_string(interval) + ".binary").c_str());
-        number_of_vertices = GetElementsNumber(outbound_filename + std::to_string(interval) + ".binary", sizeof(Outbound_t));
-        outbound_indices_arr[interval] = (Outbound_t *) malloc(number_of_vertices * sizeof(Outbound_t));
-        CHECK(number_of_vertices == fread(reinterpret_cast<char*>(&outbound_indices_arr[interval][0]), sizeof(Outbound_t), number_of_vertices, pFile));
-        fclose(pFile);
+        std::string current_outbound_filename = outbound_filename + std::to_string(interval) + ".binary";
+        
+        number_of_vertices = GetElementsNumber(current_outbound_filename, sizeof(Outbound_t));
+        sources_num.push_back(number_of_vertices);
+        outbound_indices_arr[interval] = (Outbound_t *) load_array(current_outbound_filename, (uint64_t) number_of_vertices * sizeof(Outbound_t));
       }
     }
     
     /**
      * load_vertices_values
      *
-     * load vertices' values from disk
+     * load vertices' values from disk, or map them if mmap_vertices is set
      *
      * @return  void
      */
     void load_vertices_values()
     {
       vertices_filename = inFolder + "vertex_data";
-      fd_vertices = open(vertices_filename.c_str(), O_RDWR);
-      if (fd_vertices == -1) handle_error(vertices_filename.c_str());
-      
-      vertices_data_arr = (value_t *) malloc(vertices_number * sizeof(value_t));
-      read_sys(reinterpret_cast<char*>(&vertices_data_arr[0]), vertices_number * sizeof(value_t), fd_vertices);
+      vertex_values = new VertexValues<VertexValue>();
+      vertex_values->load(vertices_filename, vertices_number, mmap_vertices, !save_values);
     }
     
     /**
      * save_vertices_values
      *
-     * save vertices' values to disk
+     * save modified vertices' values to disk
      *
      * @return  void
      */
     void save_vertices_values()
     {
-      pwrite_sys(reinterpret_cast<char*>(&vertices_data_arr[0]), vertices_number * sizeof(value_t), 0, fd_vertices);
-      free(vertices_data_arr);
-      close(fd_vertices);
+      vertex_values->save();
+      delete vertex_values;
+      vertex_values = NULL;
+    }
+    
+    /**
+     * write_back_vertex_data
+     *
+     * Start writing the modified pages of the mapped vertex data, so that the kernel can reclaim them
+     *
+     * @return  void
+     */
+    void write_back_vertex_data()
+    {
+      if (mmap_vertices){
+        vertex_values->write_back(false);
+      }
     }
     
     /**
      * assign_IDs
      *
-     * Assign ID for every shard
+     * Advance the memory shard, the other shards slide
      *
      * @return  void
      */
@@ -170,17 +248,6 @@ namespace GraphSN {
     {
       uint16_t memID = memshard->nextID();
       LOG("Memory shard for current execution interval = %u\n", memID);
-      for (uint16_t id = 0; id < intervals_number; id++){
-        if (memID == id){
-          continue;
-        }
-        else if (id < memID){
-          slidshard[id]->setID(id);
-        }
-        else{
-          slidshard[id - 1]->setID(id);
-        }
-      }
       /* set needed values */
       current_minID = intervals[memshard->getID()].first_vid;
       current_maxID = intervals[memshard->getID()].last_vid;
@@ -190,193 +257,578 @@ namespace GraphSN {
     /**
      * init_graph_vertices
      *
-     * Initialize GraphVertex array
+     * Initialize the store of the vertices, whose edges are the ones of the current interval
      *
      * @return  void
      */
     void init_graph_vertices()
     {
-      vertices = (GraphVertex *) malloc(vertices_number * sizeof(GraphVertex));
-      for (uint32_t i = 0; i < vertices_number; i++){
-        vertices[i] = GraphVertex(i, &vertices_data_arr[i], hLocks);
+      hEdges = new Edges(intervals_number);
+      store = new Store(vertex_values, hEdges);
+    }
+    
+    void prepare_shards()
+    {
+      uint16_t memID = memshard->getID();
+      
+      /* edge data written back in the previous interval may be read again */
+      edge_tracker.wait();
+      edge_tracker.clear();
+      /* the windows are queued first, the memory shard reads them together with its own edges */
+      for (int16_t interval = 0; interval < intervals_number; interval++){
+        if (interval != memID){
+          if (keep_vertices_in_memory){
+            slidshard[interval]->SetShardArray(adj_shard_arr[interval]);
+          }
+          slidshard[interval]->prepare(intervals[memID], intervals_edges[interval], hEdges);
+        }
+      }
+      if (keep_vertices_in_memory){
+        memshard->SetShardArrays(adj_shard_arr[memID], inbound_degrees_arr);
       }
+      memshard->prepare(intervals[memID], intervals_edges[memID], hEdges);
     }
     
-    void reinit_graph_vertices()
+    void prepare()
     {
-      for (uint32_t i = 0; i < vertices_number; i++){
-        vertices[i].reinitialize();
+      assign_IDs();
+      hEdges->prepare(intervals[memshard->getID()], outbound_indices_arr, sources_num, intervals_edges);
+      prepare_shards();
+    }
+    
+    /**
+     * initialize_shards
+     *
+     * Creates the shards of a run. Every shard has one sliding shard that is kept across
+     * iterations, groups read their own shards whole without the memory shard.
+     *
+     * @param   hCache  cache of the run
+     * @param   mapped  map the windows of the shards
+     * @return  void
+     */
+    void initialize_shards(Cache * hCache, bool mapped)
+    {
+      edge_tracker.clear();
+      delete memshard;
+      memshard = new Memshard(outbound_indices_arr, keep_vertices_in_memory, hCache, mapped);
+      for (int16_t interval = 0; interval < intervals_number; interval++){
+        delete slidshard[interval];
+        slidshard[interval] = new Slidshard(interval, sources_num[interval], outbound_indices_arr, keep_vertices_in_memory, hCache, mapped);
       }
     }
     
     /**
-     * reserve_outbound_mem
+     * load_shards_in_memory
      *
-     * Reserve memory for outbound edges
+     * Load shards & shards' related data in memory
      *
      * @return  void
+    */
+    void load_shards_in_memory()
+    {
+      std::string inbound_degrees_filename = inFolder + "inbound_degrees";
+      
+      /* load inbound degrees*/
+      inbound_degrees_arr = (DegreeData_t *) load_array(inbound_degrees_filename, inbound_degrees_bytes());
+      
+      /* load shards */
+      adj_shard_arr = (vertex_t **) malloc(intervals_number * sizeof(vertex_t *));
+      for (uint16_t shardID = 0; shardID < intervals_number; shardID++){
+        adj_shard_arr[shardID] = (vertex_t *) load_array(shard_filename + std::to_string(shardID), (uint64_t) intervals_edges[shardID] * sizeof(vertex_t));
+      }
+    }
+    
+    uint64_t inbound_degrees_bytes()
+    {
+      uint64_t inbound_degrees_num = 0;
+      
+      for (uint16_t shard = 0; shard < intervals_number; shard++){
+        inbound_degrees_num += intervals[shard].destinations_num;
+      }
+      return inbound_degrees_num * sizeof(DegreeData_t);
+    }
+    
+    /**
+     * adjacency_bytes
+     *
+     * Memory needed to keep the destinations of every shard and the inbound degrees
+     *
+     * @return  bytes
      */
-    void reserve_outbound_mem()
+    uint64_t adjacency_bytes()
     {
-      uint32_t * capacity;  /* amount of total out-edges */
-      std::string outbound_filename = inFolder + "Outbound/outbound_indices_";
+      uint64_t bytes = 0;
       
-      capacity = (uint32_t *) calloc(current_vertices_num, sizeof(uint32_t));
-      for (int16_t interval = 0; interval < intervals_number; interval++){
-        uint32_t number_of_vertices = GetElementsNumber(outbound_filename + std::to_string(interval) + ".binary", sizeof(Outbound_t));
+      for (uint16_t shard = 0; shard < intervals_number; shard++){
+        bytes += (uint64_t) intervals_edges[shard] * sizeof(vertex_t) + (uint64_t) intervals[shard].destinations_num * sizeof(DegreeData_t);
+      }
+      return bytes;
+    }
+    
+    /**
+     * resident_graph_bytes
+     *
+     * Memory needed by the CSR of the whole graph, besides the vertex values
+     *
+     * @return  bytes
+     */
+    uint64_t resident_graph_bytes()
+    {
+      uint64_t edges_num = 0, spans_num = 0;
+      
+      for (uint16_t shard = 0; shard < intervals_number; shard++){
+        edges_num += intervals_edges[shard];
+        spans_num += sources_num[shard];
+      }
+      /* adjacency, edge values and in-edges, out spans, offsets and degrees of every vertex */
+      return edges_num * (2 * sizeof(vertex_t) + sizeof(index_t) + sizeof(EdgeValue)) + spans_num * sizeof(OutSpan_t) +
+             (uint64_t) vertices_number * (sizeof(DegreeData_t) + 4 * sizeof(index_t));
+    }
+    
+    /**
+     * interval_bytes
+     *
+     * Memory needed to execute an interval in a group, its edges are counted as in-edges
+     * and once more as the out-edges in the sliding windows
+     *
+     * @param   interval  interval
+     * @return  bytes
+     */
+    uint64_t interval_bytes(uint16_t interval)
+    {
+      uint64_t vertices_num = intervals[interval].last_vid - intervals[interval].first_vid + 1;
+      
+      return (uint64_t) intervals_edges[interval] * (3 * sizeof(vertex_t) + sizeof(index_t) + 2 * sizeof(EdgeValue)) +
+             vertices_num * (sizeof(DegreeData_t) + 4 * sizeof(index_t));
+    }
+    
+    /**
+     * plan_interval_groups
+     *
+     * Splits the intervals in groups of consecutive intervals that are executed together.
+     * A group has at most concurrent_intervals intervals and fits in what is left of the
+     * memory budget, the largest group is reserved in it.
+     *
+     * @return  number of groups
+     */
+    uint16_t plan_interval_groups()
+    {
+      uint64_t budget, bytes = 0;
+      uint16_t limit = concurrent_intervals ? concurrent_intervals : intervals_number;
+      
+      governor.release(group_bytes);
+      budget = governor.free_bytes();
+      group_bytes = 0;
+      group_bounds.assign(1, 0);
+      for (uint16_t interval = 0; interval < intervals_number; interval++){
+        bool full = interval - group_bounds.back() == limit || bytes + interval_bytes(interval) > budget;
         
-        for (uint32_t i = 0; i < number_of_vertices; i++){
-          uint32_t vertexID = outbound_indices_arr[interval][i].vID;
-          if (vertexID < current_minID){
-            continue;
-          }
-          if (vertexID > current_maxID){
-            break;
-          }
-          if (i < number_of_vertices - 1){
-            capacity[vertexID - current_minID] += (outbound_indices_arr[interval][i+1].index - outbound_indices_arr[interval][i].index);
-          }
-          else{
-            capacity[vertexID - current_minID] += (intervals_edges[interval] - outbound_indices_arr[interval][i].index);
-          }
+        if (interval > group_bounds.back() && full){
+          group_bounds.push_back(interval);
+          bytes = 0;
         }
+        bytes += interval_bytes(interval);
+        group_bytes = std::max(group_bytes, bytes);
       }
-      /* at this point we know the exact amount of memory we will need to allocate for outbound edges*/
-      for (uint32_t i = current_minID; i <= current_maxID; i++){
-        vertices[i].allocateOutedges(capacity[i - current_minID]);
-      }
-      free(capacity);
+      group_bounds.push_back(intervals_number);
+      governor.require("Execution interval", group_bytes);
+      return group_bounds.size() - 1;
     }
     
-    void prepare_shards()
+    /**
+     * load_interval_group
+     *
+     * Loads the intervals first to last as one execution interval. Their shards are read whole,
+     * the other shards are read through sliding windows over the sources of the group, so every
+     * edge is loaded once and the intervals are updated together.
+     *
+     * @param   first   first interval of the group
+     * @param   last    last interval of the group
+     * @return  void
+     */
+    void load_interval_group(uint16_t first, uint16_t last)
     {
-      uint16_t memID = memshard->getID();
-      for (int16_t interval = 0; interval < intervals_number; interval++){
-        if (memID == interval){
-          if (keep_vertices_in_memory){
-            memshard->SetShardArrays(adj_shard_arr[memID], inbound_degrees_arr);
-          }
-          memshard->prepare(intervals[memID], intervals_edges[memID], vertices);
+      Interval_t group = {intervals[first].first_vid, intervals[last].last_vid, 0};
+      DegreeData_t * degrees;
+      uint32_t degrees_offset = 0;
+      index_t edges_num = 0;
+      
+      for (uint16_t interval = 0; interval <= last; interval++){
+        if (interval < first){
+          degrees_offset += intervals[interval].destinations_num;
         }
         else{
-          if (interval < memID){
-            if (keep_vertices_in_memory){
-              slidshard[interval]->SetShardArray(adj_shard_arr[interval]);
-            }
-            slidshard[interval]->prepare(intervals[memID], intervals_edges[interval], vertices);
-          }
-          else{
-            if (keep_vertices_in_memory){
-              slidshard[interval - 1]->SetShardArray(adj_shard_arr[interval]);
-            }
-            slidshard[interval - 1]->prepare(intervals[memID], intervals_edges[interval], vertices);
-          }
+          group.destinations_num += intervals[interval].destinations_num;
+          edges_num += intervals_edges[interval];
         }
       }
+      LOG("Execution interval of intervals %u to %u\n", first, last);
+      current_minID = group.first_vid;
+      current_maxID = group.last_vid;
+      current_vertices_num = current_maxID - current_minID + 1;
+      /* edge data written back in the previous group may be read again */
+      edge_tracker.wait();
+      edge_tracker.clear();
+      hEdges->prepare(group, outbound_indices_arr, sources_num, intervals_edges);
+      if (keep_vertices_in_memory){
+        degrees = &inbound_degrees_arr[degrees_offset];
+      }
+      else{
+        group_degrees = (DegreeData_t *) realloc(group_degrees, group.destinations_num * sizeof(DegreeData_t));
+        io().queue(inFolder + "inbound_degrees", group_degrees, group.destinations_num * sizeof(DegreeData_t),
+                   (off_t) degrees_offset * sizeof(DegreeData_t));
+        degrees = group_degrees;
+        group_adj = (vertex_t *) realloc(group_adj, (uint64_t) edges_num * sizeof(vertex_t));
+      }
+      group_edge_data = (EdgeValue *) realloc(group_edge_data, (uint64_t) edges_num * sizeof(EdgeValue));
+      
+      /* the reads of the group are queued and completed together */
+      edges_num = 0;
+      for (uint16_t shard = first; shard <= last; shard++){
+        EdgeValue * edge_data = group_edge_data + edges_num;
+        vertex_t * adj = keep_vertices_in_memory ? adj_shard_arr[shard] : group_adj + edges_num;
+        
+        if (!keep_vertices_in_memory){
+          io().queue(shard_filename + std::to_string(shard), adj, intervals_edges[shard] * sizeof(vertex_t), 0);
+        }
+        if (hCache->noCacheMode()){
+          io().queue(edge_data_filename + std::to_string(shard), edge_data, intervals_edges[shard] * sizeof(EdgeValue), 0);
+        }
+        else{
+          hCache->search_and_retrieve(shard, 0, intervals_edges[shard] * sizeof(EdgeValue), edge_data);
+        }
+        hEdges->set_shard(shard, adj, edge_data, 0);
+        edges_num += intervals_edges[shard];
+      }
+      /* out-edges of the group in the other shards */
+      for (uint16_t shard = 0; shard < intervals_number; shard++){
+        if (shard >= first && shard <= last){
+          continue;
+        }
+        if (keep_vertices_in_memory){
+          slidshard[shard]->SetShardArray(adj_shard_arr[shard]);
+        }
+        slidshard[shard]->prepare(group, intervals_edges[shard], hEdges);
+      }
+      io().complete();
+      
+      hEdges->reserve_in_edges(degrees, group.destinations_num, edges_num);
+      edges_num = 0;
+      for (uint16_t shard = first; shard <= last; shard++){
+        vertex_t * adj = keep_vertices_in_memory ? adj_shard_arr[shard] : group_adj + edges_num;
+        
+        hEdges->add_in_edges(outbound_indices_arr[shard], sources_num[shard], adj, intervals_edges[shard], edges_num);
+        edges_num += intervals_edges[shard];
+      }
+      hEdges->set_in_data(group_edge_data);
+      track_group_windows(first, last);
     }
     
-    void prepare()
+    /**
+     * track_group_windows
+     *
+     * Tracks the modified edge values of the shards of a group
+     *
+     * @param   first   first interval of the group
+     * @param   last    last interval of the group
+     * @return  void
+     */
+    void track_group_windows(uint16_t first, uint16_t last)
     {
-      assign_IDs();
-      reserve_outbound_mem();
-      prepare_shards();
+      index_t edges_num = 0;
+      
+      for (uint16_t shard = first; shard <= last; shard++){
+        edge_tracker.add_window(shard, group_edge_data + edges_num, intervals_edges[shard], 0, edge_data_filename + std::to_string(shard));
+        edges_num += intervals_edges[shard];
+      }
     }
     
-    void initialize_shards(Cache * hCache)
+    void release_group_data()
+    {
+      free(group_edge_data);
+      free(group_adj);
+      free(group_degrees);
+      group_edge_data = NULL;
+      group_adj = NULL;
+      group_degrees = NULL;
+    }
+    
+    /**
+     * release_resident_graph
+     *
+     * Frees the resident graph kept by the previous run of a session
+     *
+     * @return  void
+     */
+    void release_resident_graph()
+    {
+      release_group_data();
+      governor.release(resident_bytes);
+      resident_loaded = false;
+    }
+    
+    /**
+     * prepare_group
+     *
+     * Loads the next execution interval, a single interval with its memory shard or a group
+     *
+     * @param   group   group
+     * @return  void
+     */
+    void prepare_group(uint16_t group)
     {
-      if (memshard){
-        delete memshard;
+      if (group_bounds.size() == (size_t) intervals_number + 1){
+        prepare();
       }
-      memshard = new Memoryshard(outbound_indices_arr, keep_vertices_in_memory, hCache);
-      for (int16_t interval = 0; interval < intervals_number - 1; interval++){
-        if (slidshard[interval]){
-          delete slidshard[interval];
-        }
-        slidshard[interval] = new Slidingshard(outbound_indices_arr, keep_vertices_in_memory, hCache);
+      else{
+        load_interval_group(group_bounds[group], group_bounds[group + 1] - 1);
       }
     }
     
     /**
-     * load_shards_in_memory
+     * write_back_edge_data
      *
-     * Load shards & shards' related data in memory
+     * Write modified edge data of the current interval to disk and to the cached blocks
      *
      * @return  void
-    */
-    void load_shards_in_memory(uint32_t inbound_degrees_num)
+     */
+    void write_back_edge_data()
     {
-      int32_t     fd_inbounds;
-      std::string inbound_degrees_filename = inFolder + "inbound_degrees";
-      std::string outbound_filename = inFolder + "Outbound/outbound_indices_";
+      std::vector <DirtyRange_t> ranges = edge_tracker.collect();
       
-      /* load inbound degrees*/
-      fd_inbounds = open(inbound_degrees_filename.c_str(), O_RDONLY);
-      if (fd_inbounds == -1) handle_error(inbound_degrees_filename.c_str());
-      inbound_degrees_arr = (DegreeData_t *) malloc(inbound_degrees_num * sizeof(DegreeData_t));
-      read_sys(reinterpret_cast<char*>(&inbound_degrees_arr[0]), inbound_degrees_num * sizeof(DegreeData_t), fd_inbounds);
-      close(fd_inbounds);
+      for (uint32_t i = 0; i < ranges.size(); i++){
+        off_t start_offset = (off_t) ranges[i].first_edge * sizeof(EdgeValue);
+        hCache->update(ranges[i].shardID, start_offset, start_offset + ranges[i].elements * sizeof(EdgeValue), ranges[i].data);
+      }
+      edge_tracker.write(ranges);
+    }
+    
+    /**
+     * checkpoint_iteration
+     *
+     * Take a checkpoint at the end of every checkpoint_iterations iterations
+     *
+     * @return  void
+     */
+    void checkpoint_iteration()
+    {
+      if (hCheckpoint && hGraphbox->get_current_iteration() % checkpoint_iterations == 0){
+        hCheckpoint->save();
+      }
+    }
+    
+    template <typename UserProgram>
+    void exec_update(Lane_t<UserProgram>& lane)
+    {
+      /* a word of tasks goes to one worker, the values of its 64 vertices fill whole cache lines */
+      lane.graphbox->scheduler->for_each_task(current_minID, current_maxID, [&](vertex_t i){
+        Vertex vertex(i, lane.store);
+        
+        lane.program->update(vertex, *lane.graphbox);
+      });
+    }
+    
+    /**
+     * init_lanes
+     *
+     * The first program uses the vertex values of the engine, which are saved when the run ends
+     * unless save_values is unset. The others start from a copy of those values, kept in memory
+     * and dropped.
+     *
+     * @param   programs        programs of the batch
+     * @param   iterations_num  maximum number of iterations
+     * @return  lanes of the programs
+     */
+    template <typename UserProgram>
+    std::vector < Lane_t<UserProgram> > init_lanes(std::vector < UserProgram * >& programs, uint32_t iterations_num)
+    {
+      std::vector < Lane_t<UserProgram> > lanes(programs.size());
       
-      /* load shards */
-      adj_shard_arr = (vertex_t **) malloc(intervals_number * sizeof(vertex_t *));
-      for (uint16_t shardID = 0; shardID < intervals_number; shardID++){
-        int32_t fd_shard;
-        std::string current_shard_filename = shard_filename + std::to_string(shardID);
+      for (uint32_t l = 0; l < programs.size(); l++){
+        lanes[l].program = programs[l];
+        lanes[l].active = true;
+        if (l == 0){
+          lanes[l].values = vertex_values;
+          lanes[l].store = store;
+          lanes[l].graphbox = hGraphbox;
+          continue;
+        }
+        lanes[l].values = new VertexValues<VertexValue>();
+        lanes[l].values->copy(*vertex_values);
+        lanes[l].store = new Store(lanes[l].values, hEdges);
+        lanes[l].graphbox = new GraphBox(iterations_num, vertices_number);
+      }
+      for (uint32_t l = 0; l < lanes.size(); l++){
+        lanes[l].values->set_synchronous(synchronous);
+        lanes[l].graphbox->scheduler->set_synchronous(synchronous);
+        lanes[l].graphbox->scheduler->set_intervals(intervals);
+        lanes[l].store->bind();
+      }
+      return lanes;
+    }
+    
+    template <typename UserProgram>
+    void free_lanes(std::vector < Lane_t<UserProgram> >& lanes)
+    {
+      for (uint32_t l = 1; l < lanes.size(); l++){
+        delete lanes[l].values;
+        delete lanes[l].store;
+        delete lanes[l].graphbox;
+      }
+    }
+    
+    /**
+     * prepare_cache
+     *
+     * Creates the edge data cache. A cache of the same type and size is kept from the previous
+     * run of a session, with the blocks it already holds.
+     *
+     * @param   cache_size  cache size in bytes
+     * @param   cachetype   LRU | Indegree
+     * @return  void
+     */
+    void prepare_cache(uint64_t cache_size, std::string cachetype)
+    {
+      if (hCache && cache_size == requested_cache_size && cachetype == cache_type){
+        LOG("Using the cache of the previous run\n");
+        return;
+      }
+      if (hCache){
+        delete hCache;
+        governor.release(cache_bytes);
+      }
+      requested_cache_size = cache_size;
+      cache_type = cachetype;
+      cache_bytes = (cache_size != 0) ? governor.grant("Edge data cache", cache_size) : 0;
+      if (cachetype == "LRU"){
+        if (cache_bytes != 0){
+          LOG("Using LRU cache with size: %llu bytes\n",(long long unsigned int) cache_bytes);
+        }
+        this->hCache = new LRUCache(cache_bytes);
+      }
+      else if (cachetype == "Indegree"){
+        if (cache_bytes != 0){
+          LOG("Using Indegree cache with size: %llu bytes\n",(long long unsigned int) cache_bytes);
+        }
+        this->hCache = new IndegreeCache(cache_bytes, sizeof(EdgeValue));
         
-        fd_shard = open(current_shard_filename.c_str(), O_RDONLY);
-        adj_shard_arr[shardID] = (vertex_t *) malloc(intervals_edges[shardID] * sizeof(vertex_t));
-        read_sys(reinterpret_cast<char*>(&adj_shard_arr[shardID][0]), intervals_edges[shardID] * sizeof(vertex_t), fd_shard);
-        close(fd_shard);
+        if (keep_vertices_in_memory){
+          this->hCache->setArrays(outbound_indices_arr, inbound_degrees_arr, adj_shard_arr, true);
+        }
+        else{
+          this->hCache->setArrays(outbound_indices_arr, NULL, NULL, false);
+        }
+      }
+      else{
+        print("Unrecognized cache type\n");
+        exit(1);
       }
     }
     
-    void exec_update()
+    /**
+     * release_graph
+     *
+     * Frees the vertices, the shards kept in memory and the cache
+     *
+     * @return  void
+     */
+    void wait_prefetches()
     {
-      Scheduler * scheduler = hGraphbox->scheduler;
-      
-#pragma omp parallel for
-      for (vertex_t i = current_minID; i <= current_maxID; i++){
-        if (scheduler->is_scheduled(i)){
-          program->update(vertices[i], *hGraphbox);
+      if (prefetches){
+        prefetches->wait();
+        delete prefetches;
+        prefetches = NULL;
+      }
+    }
+    
+    void release_graph()
+    {
+      if (!store){
+        return;
+      }
+      delete store;
+      store = NULL;
+      delete hEdges;
+      hEdges = NULL;
+      if (keep_vertices_in_memory){
+        /* mapped shards may still be read in the background */
+        wait_prefetches();
+        for (uint16_t shardID = 0; shardID < intervals_number; shardID++){
+          release_array(adj_shard_arr[shardID], (uint64_t) intervals_edges[shardID] * sizeof(vertex_t));
         }
+        free(adj_shard_arr);
+        release_array(inbound_degrees_arr, inbound_degrees_bytes());
       }
+      delete hCache;
+      hCache = NULL;
     }
     
+  protected:
+    
+    bool                        session;      /* the graph stays loaded after a run */
+    bool                        save_values;  /* the values of a run are written back to vertex_data */
+    VertexValues<VertexValue> * initial_values; /* values of vertex_data, the unsaved runs of a session start from them */
     
   public:
     
     Engine()
     {
+      edge_tracker.set_value_size(sizeof(EdgeValue));
       /* reading info from file (number of shards, number of edges, number of vertices)*/
-      load_shards_info();
+      LoadShardsInfo();
       /* read [first,last] edge in each interval */
-      load_intervals();
+      LoadIntervals(intervals);
       /* read number of edges of each interval */
-      load_intervals_edges();
+      LoadIntervalsEdges(intervals_edges);
+      /* files are mapped and read in the background, the first updates fault in what they need */
+      this->lazy_startup = LAZY_STARTUP;
+      prefetches = NULL;
+      if (lazy_startup){
+        LOG("Lazy start-up mode\n");
+      }
       /* read outbound edges of each interval */
       preload_outbound_indices();
+      governor.set_budget(MEMORY_BUDGET);
+      governor.require("Outbound indices", std::accumulate(sources_num.begin(), sources_num.end(), (uint64_t) 0) * sizeof(Outbound_t));
       /* read vertices' values */
-      vertices_data_arr = NULL;
+      this->mmap_vertices = MMAP_VERTICES || lazy_startup;
+      if (mmap_vertices){
+        LOG("Memory mapped vertices mode\n");
+      }
+      vertex_values = NULL;
+      initial_values = NULL;
+      save_values = true;
       load_vertices_values();
+      /* mapped values are paged by the kernel */
+      governor.require("Vertex values", mmap_vertices ? 0 : (uint64_t) vertices_number * sizeof(VertexValue));
       
-      this->keep_vertices_in_memory = KEEP_VERTICES;
+      /* shards are read with every interval if they don't fit */
+      this->keep_vertices_in_memory = KEEP_VERTICES && governor.reserve("Adjacency", adjacency_bytes());
       if (keep_vertices_in_memory){
-        uint32_t inbound_degrees_num = 0;
-        
         LOG("Keep vertices in memory mode\n");
-        for (uint16_t shard = 0; shard < intervals_number; shard++){
-          inbound_degrees_num += intervals[shard].destinations_num;
-        }
-        load_shards_in_memory(inbound_degrees_num);
+        load_shards_in_memory();
       }
+      this->checkpoint_iterations = CHECKPOINT_ITERATIONS;
+      this->synchronous = SYNCHRONOUS_EXECUTION;
+      this->resident = RESIDENT_GRAPH;
+      this->concurrent_intervals = CONCURRENT_INTERVALS;
+      this->mmap_shards = MMAP_SHARDS;
+      group_edge_data = NULL;
+      group_adj = NULL;
+      group_degrees = NULL;
+      group_bytes = 0;
+      resident_bytes = 0;
+      resident_loaded = false;
+      hCheckpoint = NULL;
+      hCache = NULL;
+      requested_cache_size = cache_bytes = 0;
+      session = false;
       memshard = NULL;
-      slidshard = new Slidingshard *[intervals_number - 1];
-      for (uint16_t i = 0; i < intervals_number - 1; i++){
+      slidshard = new Slidshard *[intervals_number];
+      for (uint16_t i = 0; i < intervals_number; i++){
         slidshard[i] = NULL;
       }
-      hLocks = new Locks(4, vertices_number);
       init_graph_vertices();
-      omp_set_nested(1);
-      omp_set_num_threads(omp_get_max_threads() * 2);
     }
     
     ~Engine()
@@ -385,113 +837,384 @@ namespace GraphSN {
       intervals.shrink_to_fit();
       intervals_edges.shrink_to_fit();
       /* free out edges' array */
+      wait_prefetches();
       for (int16_t i = 0; i < intervals_number; i++){
-        free(outbound_indices_arr[i]);
+        release_array(outbound_indices_arr[i], (uint64_t) sources_num[i] * sizeof(Outbound_t));
       }
       free(outbound_indices_arr);
       /* delete memory shard object */
       delete memshard;
       /* delete sliding shard objects */
-      for (int16_t interval = 0; interval < intervals_number - 1; interval++){
+      for (int16_t interval = 0; interval < intervals_number; interval++){
         delete slidshard[interval];
       }
       delete [] slidshard;
-      delete hLocks;
+      /* values are saved by run, unless the engine was never run or kept by a session */
+      delete vertex_values;
+      delete initial_values;
+      io().close_files();
+      release_group_data();
+      release_graph();
+    }
+    
+    /**
+     * set_checkpoint_iterations
+     *
+     * Take a checkpoint every few iterations. If the checkpoint of an unfinished run exists,
+     * the next run resumes from it.
+     *
+     * @param   iterations    iterations between checkpoints, 0 disables them
+     * @return  void
+     */
+    void set_checkpoint_iterations(uint32_t iterations)
+    {
+      this->checkpoint_iterations = iterations;
+    }
+    
+    /**
+     * set_synchronous
+     *
+     * In synchronous mode updates read the values of the previous iteration and their writes
+     * become visible when the iteration ends, so results don't depend on the order of updates
+     *
+     * @param   synchronous   synchronous mode
+     * @return  void
+     */
+    void set_synchronous(bool synchronous)
+    {
+      this->synchronous = synchronous;
     }
     
-    void run(GraphSNProgram& main_program, uint32_t iterations_num, uint64_t cache_size, std::string cachetype)
+    /**
+     * set_resident
+     *
+     * In resident mode the shards are read once and every iteration runs against the CSR of
+     * the whole graph, if it fits in half of the memory. Otherwise intervals are loaded one by one.
+     *
+     * @param   resident    resident mode
+     * @return  void
+     */
+    void set_resident(bool resident)
+    {
+      this->resident = resident;
+    }
+    
+    /**
+     * set_concurrent_intervals
+     *
+     * Consecutive intervals are executed together, as one interval whose shards are read whole.
+     * Groups never need more than half of the memory, so they may have fewer intervals.
+     *
+     * @param   intervals   intervals of a group, 0 for as many as the memory holds
+     * @return  void
+     */
+    void set_concurrent_intervals(uint16_t intervals)
+    {
+      this->concurrent_intervals = intervals;
+    }
+    
+    /**
+     * set_mmap_shards
+     *
+     * In mmap shards mode the windows of the shards are mapped privately, so updates read the
+     * page cache without a copy and the edge data cache isn't used. Modified edge values are
+     * written back as in the other modes. Edge values must divide the page size.
+     *
+     * @param   mmap_shards   mmap shards mode
+     * @return  void
+     */
+    void set_mmap_shards(bool mmap_shards)
     {
-      this->program   = &main_program;
+      this->mmap_shards = mmap_shards;
+    }
+    
+    /**
+     * set_save_values
+     *
+     * Runs that don't save their values leave vertex_data untouched, e.g. the queries of a server
+     *
+     * @param   save_values   write the values of the next runs back to vertex_data
+     * @return  void
+     */
+    void set_save_values(bool save_values)
+    {
+      this->save_values = save_values;
+      if (vertex_values){
+        /* nothing has been written since the values were loaded, saved or reset */
+        vertex_values->set_read_only(!save_values);
+        store->bind();
+      }
+      if (save_values && initial_values){
+        /* saved runs change vertex_data */
+        governor.release(initial_values->bytes());
+        delete initial_values;
+        initial_values = NULL;
+      }
+    }
+    
+    /**
+     * set_memory_budget
+     *
+     * Memory the engine may use for the cache and the interval groups of the next runs. The
+     * adjacency is placed with MEMORY_BUDGET, when the engine is created.
+     *
+     * @param   bytes   budget, 0 for three quarters of the physical memory
+     * @return  void
+     */
+    void set_memory_budget(uint64_t bytes)
+    {
+      governor.set_budget(bytes);
+    }
+    
+    void run(Program& program, uint32_t iterations_num, uint64_t cache_size, std::string cachetype)
+    {
+      run<Program>(program, iterations_num, cache_size, cachetype);
+    }
+    
+    void run(std::vector < Program * >& programs, uint32_t iterations_num, uint64_t cache_size, std::string cachetype)
+    {
+      run<Program>(programs, iterations_num, cache_size, cachetype);
+    }
+    
+    /**
+     * run
+     *
+     * Runs a program whose functions are called directly, see StaticProgram
+     *
+     * @param   program         program, of type UserProgram
+     * @param   iterations_num  maximum number of iterations
+     * @param   cache_size      cache size in bytes
+     * @param   cachetype       LRU | Indegree
+     * @return  void
+     */
+    template <typename UserProgram>
+    void run(typename StaticProgram<UserProgram>::type& program, uint32_t iterations_num, uint64_t cache_size, std::string cachetype)
+    {
+      std::vector < UserProgram * > programs(1, &program);
+      
+      run<UserProgram>(programs, iterations_num, cache_size, cachetype);
+    }
+    
+    /**
+     * run
+     *
+     * Runs a batch of programs, e.g. independent queries, in the same passes over the shards.
+     * Every interval is loaded once and then updated by every program that is still running.
+     * Each program has its own vertex values, scheduler and iterations, the edge values are
+     * shared. Only the values of the first program are saved to vertex_data, and checkpoints
+     * are taken for single programs only.
+     *
+     * @param   programs        programs, of type UserProgram
+     * @param   iterations_num  maximum number of iterations
+     * @param   cache_size      cache size in bytes
+     * @param   cachetype       LRU | Indegree
+     * @return  void
+     */
+    template <typename UserProgram>
+    void run(std::vector < typename StaticProgram<UserProgram>::type * >& programs, uint32_t iterations_num, uint64_t cache_size, std::string cachetype)
+    {
+      std::vector < Lane_t<UserProgram> > lanes;
+      bool resident_graph = resident && intervals_number > 1;
+      bool load_once, reuse_resident, mapped_shards;
+      uint64_t engine_bytes;
+      
+      CHECK(!programs.empty());
+      /* checkpoints may roll back the edge values of a kept resident graph */
+      if (resident_loaded && (!resident_graph || (checkpoint_iterations && programs.size() == 1))){
+        release_resident_graph();
+      }
+      reuse_resident = resident_graph && resident_loaded;
+      /* a cache kept by a session is released with the reservations of the run, unless kept again */
+      engine_bytes = governor.reserved_bytes() - cache_bytes;
+      if (!store){
+        print("The graph of the engine has been released, runs after the first need an EngineSession\n");
+        exit(1);
+      }
+      if (session && !save_values && !initial_values){
+        /* the values have not been written yet, every unsaved run of the session starts from them */
+        initial_values = new VertexValues<VertexValue>();
+        initial_values->copy(*vertex_values);
+        governor.require("Initial values", initial_values->bytes());
+        engine_bytes += initial_values->bytes();
+      }
       this->hGraphbox = new GraphBox(iterations_num, vertices_number);
-      if (cachetype == "LRU"){
-        if (cache_size != 0){
-          LOG("Using LRU cache with size: %llu bytes\n",(long long unsigned int) cache_size);
-        }
-        this->hCache = new LRUCache(cache_size);
+      /* values and vertices of the other programs of a batch */
+      governor.require("Batch", (uint64_t) (programs.size() - 1) * vertices_number * sizeof(VertexValue));
+      if (reuse_resident){
+        LOG("Resident graph of the previous run\n");
       }
-      else if (cachetype == "Indegree"){
-        if (cache_size != 0){
-          LOG("Using Indegree cache with size: %llu bytes\n",(long long unsigned int) cache_size);
-        }
-        this->hCache = new IndegreeCache(cache_size);
+      else if (resident_graph){
+        uint64_t bytes = resident_graph_bytes() - std::min(resident_graph_bytes(), adjacency_bytes());
         
-        if (keep_vertices_in_memory){
-          this->hCache->setArrays(outbound_indices_arr, inbound_degrees_arr, adj_shard_arr, true);
+        /* the adjacency may already be placed */
+        bytes += keep_vertices_in_memory ? 0 : adjacency_bytes();
+        if (!governor.reserve("Resident graph", bytes)){
+          LOG("Loading intervals one by one\n");
+          resident_graph = false;
         }
         else{
-          this->hCache->setArrays(outbound_indices_arr, NULL, NULL, false);
+          LOG("Resident graph mode, %llu bytes\n", (long long unsigned int) bytes);
+          resident_bytes = bytes;
         }
       }
+      if (programs.size() > 1){
+        LOG("Batch of %u programs\n", (uint32_t) programs.size());
+      }
+      if (checkpoint_iterations && programs.size() == 1){
+        /* edge data has to be rolled back before the cache reads it */
+        hCheckpoint = new Checkpoint<VertexValue>(inFolder + "Checkpoints/", vertex_values, hGraphbox);
+        if (!hCheckpoint->resume()){
+          hCheckpoint->save();
+        }
+      }
+      if (synchronous){
+        LOG("Synchronous execution\n");
+      }
+      /* checked for every run, the setting of the caller is kept */
+      mapped_shards = mmap_shards && getpagesize() % sizeof(EdgeValue) == 0;
+      if (mmap_shards && !mapped_shards){
+        LOG("Edge values don't divide the page size, shards are read\n");
+      }
+      else if (mapped_shards && !resident_graph){
+        LOG("Memory mapped shards mode\n");
+        /* the page cache holds the edge data */
+        cache_size = 0;
+      }
+      lanes = init_lanes(programs, iterations_num);
+      if (resident_graph){
+        if (!keep_vertices_in_memory){
+          keep_vertices_in_memory = true;
+          load_shards_in_memory();
+          /* the adjacency stays after the run */
+          engine_bytes += adjacency_bytes();
+          resident_bytes -= adjacency_bytes();
+        }
+        /* every shard is read once, a cache wouldn't be hit */
+        cache_size = 0;
+      }
       else{
-        print("Unrecognized cache type\n");
-        exit(1);
+        /* a single interval is needed anyway, groups get what the cache leaves */
+        for (uint16_t interval = 0; interval < intervals_number; interval++){
+          group_bytes = std::max(group_bytes, interval_bytes(interval));
+        }
+        governor.require("Execution interval", group_bytes);
+      }
+      prepare_cache(cache_size, cachetype);
+      if (resident_graph){
+        /* the whole graph is one group */
+        group_bounds.assign(1, 0);
+        group_bounds.push_back(intervals_number);
+      }
+      else if (plan_interval_groups() < intervals_number){
+        LOG("Executing %u intervals in %u groups\n", intervals_number, (uint32_t) group_bounds.size() - 1);
       }
       timer.start("run");
-      if (intervals_number == 1){
-        initialize_shards(hCache);
-        prepare();
-        for (uint32_t iter = 0; iter < iterations_num; iter++){
-          /* start of iteration loop */
-          if (iter >= hGraphbox->get_iterations_num()){
-            break;
-          }
-          if (!hGraphbox->scheduler->has_tasks){
-            break;
-          }
-          hGraphbox->scheduler->has_tasks = false;
-          
-          program->before_iteration(*hGraphbox);
-          program->before_exec_interval(*hGraphbox);
-          exec_update();
-          program->after_exec_interval(*hGraphbox);
-          program->after_iteration(*hGraphbox);
-          
-          hGraphbox->increment_iteration();
-          hGraphbox->scheduler->swap();
-        } /* end of iteration loop */
+      /* a single interval or the resident graph is loaded once, before the first iteration */
+      load_once = intervals_number == 1 || resident_graph;
+      if (reuse_resident){
+        track_group_windows(0, intervals_number - 1);
       }
       else{
-        for (uint32_t iter = 0; iter < iterations_num; iter++){
-          /* start of iteration loop */
-          if (iter >= hGraphbox->get_iterations_num()){
-            break;
+        initialize_shards(hCache, mapped_shards);
+      }
+      if (load_once && !reuse_resident){
+        prepare_group(0);
+      }
+      for (uint32_t iter = hGraphbox->get_current_iteration(); iter < iterations_num; iter++){
+        /* start of iteration loop */
+        bool running = false;
+        
+        for (uint32_t l = 0; l < lanes.size(); l++){
+          GraphBox * graphbox = lanes[l].graphbox;
+          
+          lanes[l].active = lanes[l].active && graphbox->get_current_iteration() < graphbox->get_iterations_num() &&
+                            graphbox->scheduler->has_tasks;
+          running = running || lanes[l].active;
+        }
+        if (!running){
+          break;
+        }
+        if (!load_once){
+          uint16_t groups_num = group_bounds.size() - 1;
+          
+          /* groups shrink when the memory available to the engine drops */
+          if (concurrent_intervals != 1 && iter > 0 && plan_interval_groups() != groups_num){
+            LOG("Executing %u intervals in %u groups\n", intervals_number, (uint32_t) group_bounds.size() - 1);
           }
-          if (!hGraphbox->scheduler->has_tasks){
-            break;
+          memshard->rewind();
+        }
+        for (uint32_t l = 0; l < lanes.size(); l++){
+          if (lanes[l].active){
+            lanes[l].graphbox->reset_aggregators();
+            lanes[l].program->before_iteration(*lanes[l].graphbox);
           }
-          hGraphbox->scheduler->has_tasks = false;
-          initialize_shards(hCache);
-          
-          program->before_iteration(*hGraphbox);
-          for (uint16_t exec_inter = 0; exec_inter < intervals_number; exec_inter++){
-            /* start of interval loop */
-            reinit_graph_vertices();
-            program->before_exec_interval(*hGraphbox);
-            prepare();
-            exec_update();
-            program->after_exec_interval(*hGraphbox);
-          } /* end of interval loop */
-          program->after_iteration(*hGraphbox);
-          hGraphbox->increment_iteration();
-          hGraphbox->scheduler->swap();
-        } /* end of iteration loop */
-      }
+        }
+        for (uint16_t group = 0; group < (load_once ? 1 : group_bounds.size() - 1); group++){
+          /* start of interval loop */
+          for (uint32_t l = 0; l < lanes.size(); l++){
+            if (lanes[l].active){
+              lanes[l].program->before_exec_interval(*lanes[l].graphbox);
+            }
+          }
+          if (!load_once){
+            prepare_group(group);
+          }
+          for (uint32_t l = 0; l < lanes.size(); l++){
+            if (lanes[l].active){
+              lanes[l].values->advise_interval(current_minID, current_maxID);
+              exec_update(lanes[l]);
+              lanes[l].graphbox->merge_aggregators();
+              lanes[l].program->after_exec_interval(*lanes[l].graphbox);
+            }
+          }
+          write_back_edge_data();
+          write_back_vertex_data();
+        } /* end of interval loop */
+        for (uint32_t l = 0; l < lanes.size(); l++){
+          if (lanes[l].active){
+            lanes[l].values->end_iteration();
+            lanes[l].graphbox->merge_aggregators();
+            lanes[l].program->after_iteration(*lanes[l].graphbox);
+            lanes[l].graphbox->increment_iteration();
+            lanes[l].graphbox->scheduler->swap();
+          }
+        }
+        checkpoint_iteration();
+      } /* end of iteration loop */
       timer.end("run");
       
-      save_vertices_values();
+      edge_tracker.wait();
+      edge_tracker.clear();
+      free_lanes(lanes);
+      if (!session){
+        save_vertices_values();
+      }
+      else if (save_values){
+        /* the values stay loaded, the next run starts from them as saved */
+        LOG("%u/%u vertex data pages written back\n", vertex_values->write_back(true), vertex_values->get_pages_num());
+      }
+      else{
+        vertex_values->reset(*initial_values);
+      }
+      if (hCheckpoint){
+        hCheckpoint->finish();
+        delete hCheckpoint;
+        hCheckpoint = NULL;
+      }
       delete hGraphbox;
-      for (uint32_t i = 0; i < vertices_number; i++){
-        vertices[i].~GraphVertex();
+      if (session && resident_graph && !reuse_resident){
+        /* a session keeps the resident graph for the next run */
+        resident_loaded = true;
+        engine_bytes += resident_bytes;
       }
-      free(vertices);
-      if (keep_vertices_in_memory){
-        for (uint16_t shardID = 0; shardID < intervals_number; shardID++){
-          free(adj_shard_arr[shardID]);
-        }
-        free(adj_shard_arr);
-        free(inbound_degrees_arr);
+      governor.release(governor.reserved_bytes() - engine_bytes - (session ? cache_bytes : 0));
+      group_bytes = 0;
+      if (!resident_loaded){
+        release_group_data();
+      }
+      if (!session){
+        release_graph();
       }
-      delete hCache;
     }
   };
   
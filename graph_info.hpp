@@ -0,0 +1,82 @@
+/*
+  graph_info.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef graph_info_hpp
+#define graph_info_hpp
+
+#include <vector>
+#include <fstream>
+
+#include "types.hpp"
+
+namespace GraphSN {
+  
+  /**
+   * LoadShardsInfo
+   *
+   * reading info from file (number of shards, number of edges, number of vertices)
+   *
+   * @return  void
+   */
+  inline void LoadShardsInfo()
+  {
+    std::fstream infoshard_file;
+    
+    infoshard_file.open(inFolder + "shards.info",std::fstream::binary | std::fstream::in);
+    CHECK(infoshard_file.is_open());
+    infoshard_file >> intervals_number >> edges_num >> vertices_number;
+    infoshard_file.close();
+    
+    DBG_LOG("Number of shards = %u\n", intervals_number);
+    DBG_LOG("Number of edges = %llu\n", (unsigned long long) edges_num);
+    DBG_LOG("Number of vertices = %u\n", vertices_number);
+  }
+  
+  /**
+   * LoadIntervals
+   *
+   * read [first,last] vertex of each interval
+   *
+   * @param   intervals   intervals
+   * @return  void
+   */
+  inline void LoadIntervals(std::vector < Interval_t >& intervals)
+  {
+    std::ifstream intervals_filestream;
+    std::string intervals_filename = inFolder + "intervals.binary";
+    
+    intervals_filestream.open(intervals_filename.c_str(),std::fstream::binary | std::fstream::in);
+    if (!intervals_filestream.is_open()) handle_error(("opening " + intervals_filename).c_str());
+    intervals.resize(intervals_number);
+    intervals_filestream.read(reinterpret_cast<char*>(&intervals[0]),intervals_number * sizeof(Interval_t));
+    CHECK(intervals_filestream);
+    intervals_filestream.close();
+    for (uint32_t i = 0; i < intervals_number; i++){
+      DBG_LOG("Interval %u in [%u,%u]\n", i, intervals[i].first_vid, intervals[i].last_vid);
+    }
+  }
+  
+  /**
+   * LoadIntervalsEdges
+   *
+   * read number of edges of each interval
+   *
+   * @param   intervals_edges   number of edges of each interval
+   * @return  void
+   */
+  inline void LoadIntervalsEdges(std::vector < uint32_t >& intervals_edges)
+  {
+    std::fstream intervals_edges_file;
+    
+    intervals_edges_file.open(inFolder+"intervals_edges.binary",std::fstream::binary | std::fstream::in);
+    CHECK(intervals_edges_file.is_open());
+    intervals_edges.resize(intervals_number);
+    intervals_edges_file.read(reinterpret_cast <char*>(&intervals_edges[0]), intervals_number * sizeof(uint32_t));
+    intervals_edges_file.close();
+  }
+}
+
+#endif /* graph_info_hpp */
@@ -7,97 +7,99 @@
 #ifndef graph_objects_hpp
 #define graph_objects_hpp
 
-#include <mutex>
+#include <map>
+
 #include "scheduler.hpp"
+#include "edge_tracker.hpp"
+#include "vertex_values.hpp"
+#include "interval_edges.hpp"
+#include "aggregator.hpp"
 
 namespace GraphSN {
   
-  class Locks{
-    uint32_t num_of_vertices;
-    uint32_t edges_per_lock;
-    std::mutex * arrMutex;
+  template <typename VertexValue, typename EdgeValue>
+  class GraphVertex;
+  
+  template <typename VertexValue, typename EdgeValue>
+  class GraphEdge;
+  
+  /*
+      Vertices of a program, stored as columns: the values are kept by VertexValues, the edges of
+      the current interval by IntervalEdges, and values are updated atomically instead of under a
+      lock. GraphVertex is a handle of a vertex in its store, made when the vertex is visited, so
+      nothing is kept or reset for every vertex of the graph.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class VertexStore{
+    
+    friend class GraphVertex<VertexValue, EdgeValue>;
+    
+    VertexValue                 * data;
+    VertexValue                 * read_data;    /* differs from data in synchronous mode */
+    VertexValues<VertexValue>   * hValues;
+    IntervalEdges<VertexValue, EdgeValue> * hEdges;   /* edges of the current interval, NULL if there are none */
     
   public:
     
-    Locks(uint32_t lock_edges, uint32_t vertices_num): edges_per_lock(lock_edges)
-    {
-      uint32_t mutexes_num;
-      
-      num_of_vertices = vertices_num;
-      mutexes_num = num_of_vertices / edges_per_lock + (num_of_vertices % edges_per_lock != 0);
-      arrMutex = new std::mutex[mutexes_num];
-      DBG_LOG("Vertices: %u and Mutexes: %u\n", num_of_vertices, mutexes_num);
-    }
-    
-    ~Locks()
-    {
-      delete [] arrMutex;
-    }
-    
-    void lock(vertex_t index)
+    VertexStore(VertexValues<VertexValue> * hValues, IntervalEdges<VertexValue, EdgeValue> * hEdges = NULL): hValues(hValues), hEdges(hEdges)
     {
-      arrMutex[index / edges_per_lock].lock();
+      bind();
     }
     
-    void unlock(vertex_t index)
+    /**
+     * bind
+     *
+     * Points the store to the values, after they have been loaded or the mode of VertexValues has changed
+     *
+     * @return  void
+     */
+    void bind()
     {
-      arrMutex[index / edges_per_lock].unlock();
+      data = hValues->get(0);
+      read_data = hValues->get_read(0);
     }
   };
   
-  class GraphVertex;
-  
-  class GraphEdge{
-    
-    value_t * data;
-    GraphVertex * vertex;
-    
-  public:
+  /*
+      Vertex values are read and written with the atomic builtins, so any trivially copyable
+      VertexValue works; values wider than 8 bytes need libatomic.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class GraphVertex{
     
-    GraphEdge(GraphVertex * vertex, value_t * data): data(data), vertex(vertex){}
+    typedef GraphEdge<VertexValue, EdgeValue>       Edge;
+    typedef EdgeSpan<VertexValue, EdgeValue>        Span;
+    typedef VertexStore<VertexValue, EdgeValue>     Store;
     
-    void setData(value_t data);
-    value_t getData();
-    vertex_t getID();
-    GraphVertex * getVertex();
-  };
-  
-  class GraphVertex{
+    vertex_t    ID;
+    Store     * store;
     
-    vertex_t      ID;
-    value_t     * data;
-    Locks       * hLocks;
-    GraphEdge   * inedges, * outedges;
-    degree_t    inedges_degree, outedges_degree;
+    /* value being written, which CAS based updates start from */
+    VertexValue loadData()
+    {
+      VertexValue data;
+      __atomic_load(&store->data[this->ID], &data, __ATOMIC_RELAXED);
+      return data;
+    }
     
   public:
     
-    GraphVertex(vertex_t ID, value_t * data, Locks * hLocks): ID(ID), data(data), hLocks(hLocks),
-    inedges(NULL), outedges(NULL), inedges_degree(0), outedges_degree(0){}
+    GraphVertex(vertex_t ID, Store * store): ID(ID), store(store){}
     
-    ~GraphVertex()
+    /* neighbours are returned by value, they are used like pointers */
+    GraphVertex * operator->()
     {
-      if (getIndegree()){
-        for (uint32_t i = 0; i < getIndegree(); i++){
-          inedges[i].~GraphEdge();
-        }
-        free(inedges);
-      }
-      if (getOutdegree()){
-        for (uint32_t i = 0; i < getOutdegree(); i++){
-          outedges[i].~GraphEdge();
-        }
-        free(outedges);
-      }
+      return this;
     }
     
-    value_t getData()
+    /* values are read and written atomically, there is no lock per vertex */
+    VertexValue getData()
     {
-      value_t data;
-      hLocks->lock(this->ID);
-      data = *this->data;
-      hLocks->unlock(this->ID);
-      return data;
+      if (store->read_data != store->data){
+        /* synchronous mode, the values of the previous iteration are read-only */
+        return store->read_data[this->ID];
+      }
+      return loadData();
     }
     
     vertex_t getID()
@@ -107,95 +109,225 @@ namespace GraphSN {
     
     degree_t getIndegree()
     {
-      return this->inedges_degree;
+      return store->hEdges ? store->hEdges->indegree(this->ID) : 0;
     }
     
     degree_t getOutdegree()
     {
-      return this->outedges_degree;
+      return store->hEdges ? store->hEdges->outdegree(this->ID) : 0;
     }
     
-    GraphEdge inedge(index_t index)
+    /**
+     * inedgeSpan
+     *
+     * In-edges of the vertex, with their sources in order
+     *
+     * @return  span of the in-edges
+     */
+    Span inedgeSpan()
     {
-      CHECK(index < inedges_degree);
-      return this->inedges[index];
+      return store->hEdges ? store->hEdges->in_span(this->ID, store) : Span();
     }
     
-    GraphEdge outedge(index_t index)
+    /**
+     * outedgeSpans
+     *
+     * Out-edges are split in one span for every shard that holds some of them
+     *
+     * @return  number of spans of out-edges
+     */
+    degree_t outedgeSpans()
     {
-      CHECK(index < outedges_degree);
-      return this->outedges[index];
+      return store->hEdges ? store->hEdges->out_spans_num(this->ID) : 0;
     }
     
-    GraphEdge edge(index_t index)
+    Span outedgeSpan(index_t index)
     {
-      CHECK(index < inedges_degree + outedges_degree);
-      return (index < inedges_degree) ? inedges[index]: outedges[index - inedges_degree];
+      CHECK(index < outedgeSpans());
+      return store->hEdges->out_span(this->ID, index, store);
     }
     
-    void setData(value_t data)
+    /**
+     * edgeSpans
+     *
+     * Spans of all the edges, the in-edges first
+     *
+     * @return  number of spans
+     */
+    degree_t edgeSpans()
     {
-      hLocks->lock(this->ID);
-      *(this->data) = data;
-      hLocks->unlock(this->ID);
+      return 1 + outedgeSpans();
     }
     
-    degree_t num_edges()
+    Span edgeSpan(index_t index)
+    {
+      return (index == 0) ? inedgeSpan() : outedgeSpan(index - 1);
+    }
+    
+    /* single edges, spans are faster for scanning all of them */
+    Edge inedge(index_t index)
+    {
+      CHECK(index < getIndegree());
+      Span span = inedgeSpan();
+      return Edge(span.getVertex(index), span.getDataPtr(index));
+    }
+    
+    Edge outedge(index_t index)
+    {
+      CHECK(index < getOutdegree());
+      for (index_t s = 0; ; s++){
+        Span span = outedgeSpan(s);
+        if (index < span.size()){
+          return Edge(span.getVertex(index), span.getDataPtr(index));
+        }
+        index -= span.size();
+      }
+    }
+    
+    Edge edge(index_t index)
     {
-      return inedges_degree + outedges_degree;
+      degree_t indegree = getIndegree();
+      
+      CHECK(index < indegree + getOutdegree());
+      return (index < indegree) ? inedge(index): outedge(index - indegree);
+    }
+    
+    void setData(VertexValue data)
+    {
+      __atomic_store(&store->data[this->ID], &data, __ATOMIC_RELAXED);
+      store->hValues->mark_dirty(this->ID);
+    }
+    
+    /**
+     * compareAndSwapData
+     *
+     * Replaces the value only if it is still equal to expected
+     *
+     * @param   expected  expected value, set to the current value if the swap fails
+     * @param   data      new value
+     * @return  true if the value was replaced
+     */
+    bool compareAndSwapData(VertexValue& expected, VertexValue data)
+    {
+      if (__atomic_compare_exchange(&store->data[this->ID], &expected, &data, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        store->hValues->mark_dirty(this->ID);
+        return true;
+      }
+      return false;
     }
     
-    void reinitialize()
+    /**
+     * updateData
+     *
+     * Atomically replaces the value v with function(v)
+     *
+     * @param   function  new value for a given current value
+     * @return  previous value
+     */
+    template <typename Function>
+    VertexValue updateData(Function function)
     {
-      inedges_degree = 0;
-      outedges_degree = 0;
+      VertexValue current = loadData();
+      
+      while (!compareAndSwapData(current, function(current)));
+      return current;
     }
     
-    void allocateInedges(degree_t degree)
+    /**
+     * minData
+     *
+     * Atomically replaces the value with data, if data is smaller
+     *
+     * @param   data  candidate value
+     * @return  true if the value was replaced
+     */
+    bool minData(VertexValue data)
     {
-      inedges = (GraphEdge *) realloc(inedges, degree * sizeof(GraphEdge));
+      VertexValue current = loadData();
+      
+      while (data < current){
+        if (compareAndSwapData(current, data)){
+          return true;
+        }
+      }
+      return false;
     }
     
-    void allocateOutedges(degree_t degree)
+    /**
+     * maxData
+     *
+     * Atomically replaces the value with data, if data is larger
+     *
+     * @param   data  candidate value
+     * @return  true if the value was replaced
+     */
+    bool maxData(VertexValue data)
     {
-      outedges = (GraphEdge *) realloc(outedges, degree * sizeof(GraphEdge));
+      VertexValue current = loadData();
+      
+      while (data > current){
+        if (compareAndSwapData(current, data)){
+          return true;
+        }
+      }
+      return false;
     }
     
-    inline void addInedge(GraphVertex * source_vertex, value_t * edgeData)
+    /**
+     * addData
+     *
+     * Atomically adds data to the value
+     *
+     * @param   data  value to be added
+     * @return  new value
+     */
+    VertexValue addData(VertexValue data)
     {
-      uint32_t position = __sync_add_and_fetch(&inedges_degree, 1) - 1;
-      inedges[position] = GraphEdge(source_vertex, edgeData);
+      return updateData([data](VertexValue current){ return current + data; }) + data;
     }
     
-    inline void addOutedge(GraphVertex * dest_vertex, value_t * edgeData)
+    degree_t num_edges()
     {
-      uint32_t position = __sync_add_and_fetch(&outedges_degree, 1) - 1;
-      outedges[position] = GraphEdge(dest_vertex, edgeData);
+      return getIndegree() + getOutdegree();
     }
   };
   
-  void GraphEdge::setData(value_t data){
-    *this->data = data;
-  }
-  
-  value_t GraphEdge::getData()
-  {
-    return *this->data;
-  }
-  
-  GraphVertex * GraphEdge::getVertex()
-  {
-    return this->vertex;
-  }
-  
-  vertex_t GraphEdge::getID()
-  {
-    return this->vertex->getID();
-  }
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class GraphEdge{
+    
+    EdgeValue * data;
+    GraphVertex<VertexValue, EdgeValue> vertex;
+    
+  public:
+    
+    GraphEdge(GraphVertex<VertexValue, EdgeValue> vertex, EdgeValue * data): data(data), vertex(vertex){}
+    
+    void setData(EdgeValue data)
+    {
+      *this->data = data;
+      edge_tracker.mark_dirty(this->data);
+    }
+    
+    EdgeValue getData()
+    {
+      return *this->data;
+    }
+    
+    vertex_t getID()
+    {
+      return this->vertex.getID();
+    }
+    
+    GraphVertex<VertexValue, EdgeValue> getVertex()
+    {
+      return this->vertex;
+    }
+  };
   
   class GraphBox{
     uint32_t    current_iteration;
     uint32_t    iterations_num;
+    std::map < std::string, AggregatorBase * > aggregators;
     
   public:
     
@@ -210,6 +342,9 @@ namespace GraphSN {
     ~GraphBox()
     {
       delete this->scheduler;
+      for (std::map < std::string, AggregatorBase * >::iterator it = aggregators.begin(); it != aggregators.end(); it++){
+        delete it->second;
+      }
     }
     
     uint32_t get_current_iteration()
@@ -227,10 +362,85 @@ namespace GraphSN {
       this->current_iteration++;
     }
     
+    void set_current_iteration(uint32_t iteration)
+    {
+      this->current_iteration = iteration;
+    }
+    
     void set_last_iteration(uint32_t iteration)
     {
       this->iterations_num = iteration;
     }
+    
+    /**
+     * get_aggregator
+     *
+     * Aggregator of the given name, created the first time it is asked for. Programs ask for it
+     * outside update, e.g. in before_iteration. Aggregators are reset before every iteration and
+     * merged after every interval, so after_iteration reads the value of the whole iteration.
+     *
+     * @param   name      name of the aggregator
+     * @param   monoid    identity and combination of the values
+     * @return  aggregator
+     */
+    template <typename T, typename Monoid>
+    Aggregator<T, Monoid> * get_aggregator(std::string name, Monoid monoid)
+    {
+      Aggregator<T, Monoid> * aggregator;
+      std::map < std::string, AggregatorBase * >::iterator it = aggregators.find(name);
+      
+      if (it != aggregators.end()){
+        aggregator = dynamic_cast<Aggregator<T, Monoid> *>(it->second);
+        CHECK(aggregator);
+        return aggregator;
+      }
+      aggregator = new Aggregator<T, Monoid>(monoid);
+      aggregators[name] = aggregator;
+      return aggregator;
+    }
+    
+    template <typename T>
+    Aggregator<T, SumMonoid<T> > * sum_aggregator(std::string name)
+    {
+      return get_aggregator<T>(name, SumMonoid<T>());
+    }
+    
+    template <typename T>
+    Aggregator<T, MinMonoid<T> > * min_aggregator(std::string name)
+    {
+      return get_aggregator<T>(name, MinMonoid<T>());
+    }
+    
+    template <typename T>
+    Aggregator<T, MaxMonoid<T> > * max_aggregator(std::string name)
+    {
+      return get_aggregator<T>(name, MaxMonoid<T>());
+    }
+    
+    /* add(1) counts */
+    Aggregator<uint64_t, SumMonoid<uint64_t> > * count_aggregator(std::string name)
+    {
+      return get_aggregator<uint64_t>(name, SumMonoid<uint64_t>());
+    }
+    
+    Aggregator<bool, OrMonoid> * or_aggregator(std::string name)
+    {
+      return get_aggregator<bool>(name, OrMonoid());
+    }
+    
+    void reset_aggregators()
+    {
+      for (std::map < std::string, AggregatorBase * >::iterator it = aggregators.begin(); it != aggregators.end(); it++){
+        it->second->reset();
+      }
+    }
+    
+    void merge_aggregators()
+    {
+      for (std::map < std::string, AggregatorBase * >::iterator it = aggregators.begin(); it != aggregators.end(); it++){
+        it->second->merge();
+      }
+    }
   };
 }
 
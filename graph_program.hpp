@@ -8,10 +8,26 @@
 
 namespace GraphSN {
   
+  /*
+      run<UserProgram> of the engines instantiates their loops with the type of the program, so
+      its functions are called directly and small ones are inlined. UserProgram needs the same
+      functions as the program interfaces below but doesn't have to derive from them; a derived
+      program has to be final for its overrides to be devirtualized. The program argument is not
+      deduced, so a plain run call keeps going through the virtual interface.
+  */
+  template <typename UserProgram>
+  struct StaticProgram{
+    typedef UserProgram type;
+  };
+  
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
   class GraphSNProgram {
     
   public:
     
+    typedef GraphVertex<VertexValue, EdgeValue> Vertex;
+    typedef EdgeSpan<VertexValue, EdgeValue>    Span;
+    
     virtual ~GraphSNProgram() {}
     
     /**
@@ -37,6 +53,61 @@ namespace GraphSN {
     /**
      * Update function.
      */
-    virtual void update(GraphVertex& v, GraphBox& graphbox) = 0;
+    virtual void update(Vertex& v, GraphBox& graphbox) = 0;
+  };
+  
+  /*
+      Program of the edge-centric StreamingEngine. The edges of every scheduled vertex are
+      streamed through scatter, which produces updates for their destinations, and gather
+      applies the updates to the vertices.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class GraphSNStreamingProgram {
+    
+  public:
+    
+    typedef GraphVertex<VertexValue, EdgeValue> Vertex;
+    
+    virtual ~GraphSNStreamingProgram() {}
+    
+    /**
+     * Called for every vertex before the first iteration.
+     */
+    virtual void initialize(Vertex& v, GraphBox& graphbox) = 0;
+    
+    /**
+     * Called before an iteration starts.
+     */
+    virtual void before_iteration(GraphBox& graphbox) = 0;
+    /**
+     * Called after an iteration has finished.
+     */
+    virtual void after_iteration(GraphBox& graphbox) = 0;
+    
+    /**
+     * Called before the updates of an execution interval are gathered.
+     */
+    virtual void before_exec_interval(GraphBox& graphbox) = 0;
+    
+    /**
+     * Called after the updates of an execution interval have been gathered.
+     */
+    virtual void after_exec_interval(GraphBox& graphbox) = 0;
+    
+    /**
+     * Called for every edge of a scheduled source. Returns true if update has to be sent to dst.
+     */
+    virtual bool scatter(vertex_t src, VertexValue src_value, vertex_t dst, EdgeValue edge_data,
+                         VertexValue& update, GraphBox& graphbox) = 0;
+    
+    /**
+     * Called for every update. Updates of the same vertex may be gathered concurrently.
+     */
+    virtual void gather(Vertex& v, VertexValue update, GraphBox& graphbox) = 0;
+    
+    /**
+     * If true, every edge is also streamed from its destination to its source.
+     */
+    virtual bool undirected() { return false; }
   };
 }
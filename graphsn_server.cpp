@@ -0,0 +1,471 @@
+/*
+  graphsn_server.cpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "timer.hpp"
+#include "preprocessing.hpp"
+#include "engine_session.hpp"
+#include "scheduler.hpp"
+
+#define MAX_BATCH_QUERIES 64    /* queries answered in the same passes over the shards */
+#define MAX_REQUEST_BYTES 4096
+
+using namespace GraphSN;
+
+typedef vertex_t  VertexValue;  /* label, hops or component of the vertex for the query, -1 if none */
+typedef float     EdgeValue;    /* not used by the queries */
+
+/*
+    Queries of the server, one program of the batch each:
+      distance <u> <v>    length of the shortest path between u and v, edges in both directions
+      khop <u> <k>        vertices at most k hops away from u
+      component <u>       smallest vertex ID of the connected component of u
+*/
+typedef enum {DISTANCE, KHOP, COMPONENT} query_t;
+
+class Query final : public GraphSNProgram<VertexValue, EdgeValue>{
+  
+  uint32_t * levels;      /* distance from the vertex the search that reached it started from */
+  Aggregator<value_t, MinMonoid<value_t> > * paths;
+  Aggregator<bool, OrMonoid> * changed;
+  bool collecting;
+  
+  void update_distance(Vertex& vertex, GraphBox& graphbox)
+  {
+    VertexValue label;
+    uint32_t level;
+    
+    if (graphbox.get_current_iteration() == 0){
+      if (vertex.getID() == source || vertex.getID() == target){
+        vertex.setData(vertex.getID());
+        graphbox.scheduler->add_task(vertex.getID());
+      }
+      else{
+        vertex.setData(-1);
+      }
+      return;
+    }
+    label = vertex.getData();
+    level = levels[vertex.getID()];
+    for (uint32_t s = 0; s < vertex.edgeSpans(); s++){
+      Span edges = vertex.edgeSpan(s);
+      for (uint32_t i = 0; i < edges.size(); i++){
+        VertexValue data = -1;
+        /* only one of the vertices that reach an unvisited neighbour labels it */
+        if (edges.getVertex(i)->compareAndSwapData(data, label)){
+          levels[edges.getID(i)] = level + 1;
+          graphbox.scheduler->add_task(edges.getID(i));
+        }
+        else if (data != label){
+          paths->add(level + levels[edges.getID(i)] + 1);
+        }
+      }
+    }
+  }
+  
+  void update_khop(Vertex& vertex, GraphBox& graphbox)
+  {
+    VertexValue hops;
+    
+    if (graphbox.get_current_iteration() == 0){
+      vertex.setData((vertex.getID() == source) ? 0 : -1);
+      if (vertex.getID() == source){
+        graphbox.scheduler->add_task(vertex.getID());
+      }
+      return;
+    }
+    hops = vertex.getData() + 1;
+    for (uint32_t s = 0; s < vertex.edgeSpans(); s++){
+      Span edges = vertex.edgeSpan(s);
+      for (uint32_t i = 0; i < edges.size(); i++){
+        VertexValue data = -1;
+        
+        if (edges.getVertex(i)->compareAndSwapData(data, hops)){
+          reached[edges.getID(i)] = 1;
+          graphbox.scheduler->add_task(edges.getID(i));
+        }
+      }
+    }
+  }
+  
+  void update_component(Vertex& vertex, GraphBox& graphbox)
+  {
+    vertex_t label;
+    
+    if (collecting){
+      labels[vertex.getID()] = vertex.getData();
+      return;
+    }
+    if (graphbox.get_current_iteration() == 0){
+      vertex.setData(vertex.getID());
+      graphbox.scheduler->add_task(vertex.getID());
+      return;
+    }
+    label = vertex.getData();
+    for (uint32_t s = 0; s < vertex.edgeSpans(); s++){
+      Span edges = vertex.edgeSpan(s);
+      for (uint32_t i = 0; i < edges.size(); i++){
+        label = std::min<vertex_t>(label, edges.getVertex(i)->getData());
+      }
+    }
+    vertex.minData(label);
+    for (uint32_t s = 0; s < vertex.edgeSpans(); s++){
+      Span edges = vertex.edgeSpan(s);
+      for (uint32_t i = 0; i < edges.size(); i++){
+        if (edges.getVertex(i)->minData(label)){
+          graphbox.scheduler->add_task(edges.getID(i));
+          changed->add(true);
+        }
+      }
+    }
+  }
+  
+public:
+  
+  query_t                 type;
+  vertex_t                source, target;   /* target is the hops of khop queries */
+  value_t                 distance;
+  std::vector < uint8_t > reached;
+  std::vector < vertex_t > labels;
+  
+  Query(query_t type, vertex_t source, vertex_t target): levels(NULL), paths(NULL), changed(NULL),
+  collecting(false), type(type), source(source), target(target), distance(-1){}
+  
+  ~Query()
+  {
+    free(levels);
+  }
+  
+  void update(Vertex& vertex, GraphBox& graphbox) {
+    graphbox.scheduler->remove_task(vertex.getID());
+    if (type == DISTANCE){
+      update_distance(vertex, graphbox);
+    }
+    else if (type == KHOP){
+      update_khop(vertex, graphbox);
+    }
+    else{
+      update_component(vertex, graphbox);
+    }
+  }
+  
+  void before_iteration(GraphBox& graphbox) {
+    if (graphbox.get_current_iteration() == 0){
+      if (type == DISTANCE){
+        levels = (uint32_t *) calloc(vertices_number, sizeof(uint32_t));
+      }
+      else if (type == KHOP){
+        reached.assign(vertices_number, 0);
+        reached[source] = 1;
+      }
+      else{
+        labels.assign(vertices_number, 0);
+      }
+    }
+    paths = graphbox.min_aggregator<value_t>("paths");
+    changed = graphbox.or_aggregator("changed");
+  }
+  
+  void after_iteration(GraphBox& graphbox) {
+    uint32_t iteration = graphbox.get_current_iteration();
+    
+    if (type == DISTANCE && paths->get() < std::numeric_limits<value_t>::max()){
+      distance = paths->get();
+      graphbox.set_last_iteration(iteration);
+    }
+    else if (type == KHOP && iteration == target){
+      graphbox.set_last_iteration(iteration);
+    }
+    else if (type == COMPONENT && collecting){
+      graphbox.set_last_iteration(iteration);
+    }
+    else if (type == COMPONENT && iteration > 0 && !changed->get()){
+      /* labels of the lane aren't kept after the run, every vertex records its own */
+      collecting = true;
+      for (vertex_t ID = 0; ID < vertices_number; ID++){
+        graphbox.scheduler->add_task(ID);
+      }
+    }
+  }
+  
+  void before_exec_interval(GraphBox& graphbox) {
+    SILENCE(graphbox);
+  }
+  
+  void after_exec_interval(GraphBox& graphbox) {
+    SILENCE(graphbox);
+  }
+  
+};
+
+/* answer to a request, sent in the order the requests of the round arrived */
+typedef struct Reply_s{
+  int32_t       client;
+  Query *       query;        /* query that computes the answer, NULL if it's known */
+  int64_t       component;    /* vertex of a component request, -1 for the other requests */
+  std::string   answer;
+}Reply_t;
+
+/**
+ * parse_request
+ *
+ * Answers a request that needs no run, or creates its query
+ *
+ * @param   client      socket of the client
+ * @param   request     line of the request
+ * @param   components  labels of the components, empty until they are computed
+ * @param   queries     queries of the next batch
+ * @param   replies     replies of the next batch
+ * @return  false if the server has to stop
+ */
+bool parse_request(int32_t client, std::string request, std::vector < vertex_t >& components,
+                   std::vector < Query * >& queries, std::vector < Reply_t >& replies)
+{
+  std::istringstream words(request);
+  std::string command;
+  int64_t u = -1, v = -1;
+  Reply_t reply = {client, NULL, -1, ""};
+  
+  words >> command;
+  if (command == "shutdown"){
+    reply.answer = "bye";
+    replies.push_back(reply);
+    return false;
+  }
+  if (command != "distance" && command != "khop" && command != "component"){
+    reply.answer = "error unknown request \"" + command + "\"";
+    replies.push_back(reply);
+    return true;
+  }
+  words >> u;
+  if (command != "component"){
+    words >> v;
+  }
+  if (words.fail() || u < 0 || u >= vertices_number || (command != "component" && v < 0) ||
+      (command == "distance" && v >= vertices_number)){
+    reply.answer = "error bad arguments in \"" + request + "\"";
+  }
+  else if (command == "distance"){
+    if (u == v){
+      reply.answer = "distance " + std::to_string(u) + " " + std::to_string(v) + " 0";
+    }
+    else{
+      reply.query = new Query(DISTANCE, u, v);
+    }
+  }
+  else if (command == "khop"){
+    if (v == 0){
+      reply.answer = "khop " + std::to_string(u) + " 0 1 " + std::to_string(u);
+    }
+    else{
+      /* no vertex is further than vertices_number hops */
+      reply.query = new Query(KHOP, u, std::min<int64_t>(v, vertices_number));
+    }
+  }
+  else if (!components.empty()){
+    reply.answer = "component " + std::to_string(u) + " " + std::to_string(components[u]);
+  }
+  else{
+    reply.component = u;
+  }
+  if (reply.query){
+    queries.push_back(reply.query);
+  }
+  replies.push_back(reply);
+  return true;
+}
+
+/**
+ * answer_batch
+ *
+ * Runs the queries of a batch in shared passes and sends the replies
+ *
+ * @param   session     engine session
+ * @param   components  labels of the components, filled by the first component query
+ * @param   queries     queries of the batch
+ * @param   replies     replies of the batch
+ * @return  void
+ */
+void answer_batch(EngineSession<VertexValue, EdgeValue> * session, std::vector < vertex_t >& components,
+                  std::vector < Query * >& queries, std::vector < Reply_t >& replies)
+{
+  uint32_t iterations = 0;
+  
+  /* the graph doesn't change, components are computed once for all requests */
+  for (uint32_t i = 0; i < replies.size(); i++){
+    if (replies[i].component >= 0){
+      queries.push_back(new Query(COMPONENT, 0, 0));
+      break;
+    }
+  }
+  if (!queries.empty()){
+    for (uint32_t i = 0; i < queries.size(); i++){
+      iterations = std::max<uint32_t>(iterations, (queries[i]->type == KHOP) ? queries[i]->target + 1 : vertices_number + 2);
+    }
+    LOG("Answering %u queries\n", (uint32_t) queries.size());
+    timer.start("batch");
+    session->run<Query>(queries, iterations, 0, "LRU");
+    timer.end("batch");
+  }
+  for (uint32_t i = 0; i < queries.size(); i++){
+    if (queries[i]->type == COMPONENT){
+      components.swap(queries[i]->labels);
+    }
+  }
+  for (uint32_t i = 0; i < replies.size(); i++){
+    Reply_t& reply = replies[i];
+    Query * query = reply.query;
+    
+    if (reply.component >= 0){
+      reply.answer = "component " + std::to_string(reply.component) + " " + std::to_string(components[reply.component]);
+    }
+    else if (query && query->type == DISTANCE){
+      reply.answer = "distance " + std::to_string(query->source) + " " + std::to_string(query->target) + " " +
+                     std::to_string((int64_t) query->distance);
+    }
+    else if (query){
+      uint32_t count = 0;
+      std::string members;
+      
+      for (vertex_t ID = 0; ID < vertices_number; ID++){
+        if (query->reached[ID]){
+          members += " " + std::to_string(ID);
+          count++;
+        }
+      }
+      reply.answer = "khop " + std::to_string(query->source) + " " + std::to_string(query->target) + " " + std::to_string(count) + members;
+    }
+    reply.answer += "\n";
+    if (send(reply.client, reply.answer.c_str(), reply.answer.size(), MSG_NOSIGNAL) != (ssize_t) reply.answer.size()){
+      LOG("Answer to client %d was not sent\n", reply.client);
+    }
+  }
+  for (uint32_t i = 0; i < queries.size(); i++){
+    delete queries[i];
+  }
+  queries.clear();
+  replies.clear();
+}
+
+int main(int argc, const char * argv[]) {
+  
+  int32_t listener;
+  bool running = true;
+  struct sockaddr_un address;
+  std::string socket_path;
+  std::vector < struct pollfd > sockets;
+  std::vector < std::string > buffers;
+  std::vector < Query * > queries;
+  std::vector < Reply_t > replies;
+  std::vector < vertex_t > components;
+  EngineSession<VertexValue, EdgeValue> * session;
+  Preprocessing<VertexValue, EdgeValue> hPreprocessing;
+  
+  if (argc != 2 && argc != 3){
+    LOG("Expected: ./graphsn_server [file_name] [socket]\n");
+    exit(1);
+  }
+  std::cout << "Query server" << std::endl;
+  GraphSNInit(2, argv);
+  hPreprocessing.CheckPreprocessing(inFolder);
+  session = new EngineSession<VertexValue, EdgeValue>();
+  session->set_resident(true);
+  /* queries never change the graph */
+  session->set_save_values(false);
+  
+  socket_path = (argc == 3) ? argv[2] : inFolder + "graphsn.sock";
+  if (socket_path.size() >= sizeof(address.sun_path)){
+    LOG("Socket path %s is too long\n", socket_path.c_str());
+    exit(1);
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener == -1) handle_error("creating socket");
+  unlink(socket_path.c_str());
+  if (bind(listener, (struct sockaddr *) &address, sizeof(address)) == -1) handle_error(("binding " + socket_path).c_str());
+  if (listen(listener, SOMAXCONN) == -1) handle_error("listening");
+  LOG("Listening on %s\n", socket_path.c_str());
+  
+  sockets.push_back({listener, POLLIN, 0});
+  buffers.push_back("");
+  while (running){
+    if (poll(sockets.data(), sockets.size(), -1) == -1){
+      if (errno == EINTR){
+        continue;
+      }
+      handle_error("polling sockets");
+    }
+    if (sockets[0].revents & POLLIN){
+      int32_t client = accept(listener, NULL, NULL);
+      
+      if (client != -1){
+        sockets.push_back({client, POLLIN, 0});
+        buffers.push_back("");
+      }
+    }
+    /* requests that arrived together are answered by the same batch */
+    for (uint32_t i = 1; i < sockets.size() && running; i++){
+      char data[MAX_REQUEST_BYTES];
+      ssize_t bytes;
+      size_t end;
+      
+      if (!(sockets[i].revents & (POLLIN | POLLHUP | POLLERR))){
+        continue;
+      }
+      bytes = recv(sockets[i].fd, data, sizeof(data), 0);
+      if (bytes <= 0){
+        sockets[i].fd = -sockets[i].fd - 1;
+        continue;
+      }
+      buffers[i].append(data, bytes);
+      while ((end = buffers[i].find('\n')) != std::string::npos && running){
+        std::string request = buffers[i].substr(0, end);
+        
+        buffers[i].erase(0, end + 1);
+        running = parse_request(sockets[i].fd, request, components, queries, replies);
+        if (queries.size() + 1 >= MAX_BATCH_QUERIES){
+          answer_batch(session, components, queries, replies);
+        }
+      }
+      if (buffers[i].size() > MAX_REQUEST_BYTES){
+        Reply_t reply = {sockets[i].fd, NULL, -1, "error request too long"};
+        
+        replies.push_back(reply);
+        buffers[i].clear();
+      }
+    }
+    if (!replies.empty()){
+      answer_batch(session, components, queries, replies);
+    }
+    /* drop the clients that closed their socket */
+    for (uint32_t i = sockets.size() - 1; i > 0; i--){
+      if (sockets[i].fd < 0){
+        close(-sockets[i].fd - 1);
+        sockets.erase(sockets.begin() + i);
+        buffers.erase(buffers.begin() + i);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < sockets.size(); i++){
+    close(sockets[i].fd < 0 ? -sockets[i].fd - 1 : sockets[i].fd);
+  }
+  unlink(socket_path.c_str());
+  timer.print_timing_report();
+  
+  delete session;
+  return 0;
+}
@@ -0,0 +1,341 @@
+/*
+  interval_edges.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef interval_edges_hpp
+#define interval_edges_hpp
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+namespace GraphSN {
+  
+  template <typename VertexValue, typename EdgeValue>
+  class GraphVertex;
+  
+  template <typename VertexValue, typename EdgeValue>
+  class VertexStore;
+  
+  /* out-edges of a source in one shard, which are contiguous there */
+  typedef struct OutSpan_s{
+    index_t   first_edge;   /* position of the first edge in the shard */
+    degree_t  count;
+    uint32_t  shardID;
+  }OutSpan_t;
+  
+  /* edges of a shard loaded for the current interval, adj[0] and data[0] belong to first_edge */
+  template <typename EdgeValue>
+  struct ShardEdges_t{
+    vertex_t    * adj;
+    EdgeValue   * data;
+    index_t       first_edge;
+  };
+  
+  /*
+      Edges of a vertex whose neighbours are contiguous in memory. The values of out-edges are
+      contiguous too, the values of in-edges are found through their positions in the memory shard.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class EdgeSpan{
+    
+    typedef GraphVertex<VertexValue, EdgeValue> Vertex;
+    typedef VertexStore<VertexValue, EdgeValue> Store;
+    
+    Store           * store;        /* vertices of the neighbours */
+    const vertex_t  * neighbours;
+    const index_t   * positions;    /* NULL if the values are contiguous */
+    EdgeValue       * data;
+    degree_t          count;
+    
+  public:
+    
+    EdgeSpan(): store(NULL), neighbours(NULL), positions(NULL), data(NULL), count(0){}
+    
+    EdgeSpan(Store * store, const vertex_t * neighbours, const index_t * positions, EdgeValue * data, degree_t count):
+    store(store), neighbours(neighbours), positions(positions), data(data), count(count){}
+    
+    degree_t size()
+    {
+      return count;
+    }
+    
+    /* IDs of the neighbours, size() of them */
+    const vertex_t * getIDs()
+    {
+      return neighbours;
+    }
+    
+    vertex_t getID(degree_t index)
+    {
+      return neighbours[index];
+    }
+    
+    /* handle of the neighbour, used like a pointer */
+    Vertex getVertex(degree_t index)
+    {
+      return Vertex(neighbours[index], store);
+    }
+    
+    EdgeValue * getDataPtr(degree_t index)
+    {
+      return positions ? &data[positions[index]] : &data[index];
+    }
+    
+    EdgeValue getData(degree_t index)
+    {
+      return *getDataPtr(index);
+    }
+    
+    void setData(degree_t index, EdgeValue value)
+    {
+      EdgeValue * edge_data = getDataPtr(index);
+      
+      *edge_data = value;
+      edge_tracker.mark_dirty(edge_data);
+    }
+  };
+  
+  /*
+      CSR of the edges of the current execution interval, pointing into the loaded shards.
+      In-edges are grouped by destination as source IDs and positions in the memory shard,
+      out-edges are the spans of every source in every shard. In resident mode the interval
+      is the whole graph and the positions refer to the edge values of all shards.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class IntervalEdges{
+    
+    typedef VertexStore<VertexValue, EdgeValue> Store;
+    typedef EdgeSpan<VertexValue, EdgeValue>    Span;
+    
+    vertex_t                                  first_vid, last_vid;
+    EdgeValue *                               in_data;        /* values the positions of in-edges refer to */
+    std::vector < ShardEdges_t<EdgeValue> >   shards;
+    std::vector < index_t >                   in_offsets;     /* in-edges of destination v start at in_offsets[v - first_vid] */
+    std::vector < index_t >                   in_fill;
+    std::vector < index_t >                   in_counts;      /* in-edges of every destination in every chunk of a shard */
+    std::vector < vertex_t >                  in_neighbours;
+    std::vector < index_t >                   in_positions;
+    std::vector < index_t >                   out_offsets;    /* out spans of source v start at out_offsets[v - first_vid] */
+    std::vector < degree_t >                  out_degrees;
+    std::vector < OutSpan_t >                 out_spans;
+    
+  public:
+    
+    IntervalEdges(uint16_t shards_num): first_vid(1), last_vid(0), in_data(NULL), shards(shards_num){}
+    
+    bool contains(vertex_t ID)
+    {
+      return ID >= first_vid && ID <= last_vid;
+    }
+    
+    /**
+     * prepare
+     *
+     * Starts an execution interval and finds the out spans of its vertices
+     *
+     * @param   interval                bounds of the interval
+     * @param   outbound_indices_arr    sources of every shard and the position of their first edge
+     * @param   sources_num             number of sources of every shard
+     * @param   edges_num               number of edges of every shard
+     * @return  void
+     */
+    void prepare(Interval_t interval, Outbound_t ** outbound_indices_arr, std::vector < uint32_t >& sources_num, std::vector < uint32_t >& edges_num)
+    {
+      uint32_t vertices_num = interval.last_vid - interval.first_vid + 1;
+      std::vector < uint32_t > begin(shards.size()), end(shards.size());
+      std::vector < index_t > out_fill;
+      
+      first_vid = interval.first_vid;
+      last_vid = interval.last_vid;
+      out_offsets.assign(vertices_num + 1, 0);
+      out_degrees.assign(vertices_num, 0);
+      /* sources of the interval are contiguous in the outbound indices of every shard */
+      for (uint16_t shard = 0; shard < shards.size(); shard++){
+        Outbound_t * first = outbound_indices_arr[shard], * last = first + sources_num[shard];
+        
+        begin[shard] = std::lower_bound(first, last, first_vid, [](const Outbound_t& source, vertex_t ID){ return source.vID < ID; }) - first;
+        end[shard] = std::upper_bound(first, last, last_vid, [](vertex_t ID, const Outbound_t& source){ return ID < source.vID; }) - first;
+        for (uint32_t i = begin[shard]; i < end[shard]; i++){
+          out_offsets[first[i].vID - first_vid + 1]++;
+        }
+      }
+      std::partial_sum(out_offsets.begin(), out_offsets.end(), out_offsets.begin());
+      out_spans.resize(out_offsets[vertices_num]);
+      out_fill.assign(out_offsets.begin(), out_offsets.end() - 1);
+      for (uint16_t shard = 0; shard < shards.size(); shard++){
+        Outbound_t * sources = outbound_indices_arr[shard];
+        
+        for (uint32_t i = begin[shard]; i < end[shard]; i++){
+          index_t last_edge = (i + 1 < sources_num[shard]) ? sources[i + 1].index : edges_num[shard];
+          OutSpan_t span = {sources[i].index, last_edge - sources[i].index, shard};
+          
+          out_spans[out_fill[sources[i].vID - first_vid]++] = span;
+          out_degrees[sources[i].vID - first_vid] += span.count;
+        }
+      }
+    }
+    
+    /**
+     * set_shard
+     *
+     * Sets the edges loaded from a shard for the current interval
+     *
+     * @param   shardID       shardID
+     * @param   adj           destinations, adj[0] is the edge at first_edge
+     * @param   data          edge values, data[0] is the edge at first_edge
+     * @param   first_edge    position of the first loaded edge in the shard
+     * @return  void
+     */
+    void set_shard(uint16_t shardID, vertex_t * adj, EdgeValue * data, index_t first_edge)
+    {
+      ShardEdges_t<EdgeValue> edges = {adj, data, first_edge};
+      
+      shards[shardID] = edges;
+    }
+    
+    /**
+     * reserve_in_edges
+     *
+     * Reserves the in-edges of the interval
+     *
+     * @param   degrees             in-degrees of the destinations of the interval
+     * @param   destinations_num    number of destinations
+     * @param   edges_num           number of in-edges
+     * @return  void
+     */
+    void reserve_in_edges(DegreeData_t * degrees, uint32_t destinations_num, index_t edges_num)
+    {
+      in_offsets.assign(last_vid - first_vid + 2, 0);
+      for (uint32_t i = 0; i < destinations_num; i++){
+        in_offsets[degrees[i].vID - first_vid + 1] = degrees[i].degree;
+      }
+      std::partial_sum(in_offsets.begin(), in_offsets.end(), in_offsets.begin());
+      in_fill.assign(in_offsets.begin(), in_offsets.end() - 1);
+      in_neighbours.resize(edges_num);
+      in_positions.resize(edges_num);
+    }
+    
+    /**
+     * add_in_edges
+     *
+     * Groups the edges of a shard by destination with a counting sort. The shard is split in
+     * chunks of sources with about the same number of edges. Every chunk counts its edges per
+     * destination, the counts become the first slot of the chunk in every destination and the
+     * chunks place their edges there. No slot is shared, and the in-edges of a destination keep
+     * the order of the shards, their sources and their edges.
+     *
+     * @param   sources           sources of the shard and the position of their first edge
+     * @param   sources_num       number of sources
+     * @param   adj               destinations of the edges of the shard
+     * @param   edges_num         number of edges of the shard
+     * @param   first_position    position of the first edge of the shard in the in-edge values
+     * @return  void
+     */
+    void add_in_edges(Outbound_t * sources, uint32_t sources_num, vertex_t * adj, index_t edges_num, index_t first_position)
+    {
+      uint32_t destinations_num = last_vid - first_vid + 1;
+      uint32_t chunks_num;
+      std::vector < uint32_t > chunk_sources;
+      
+      if (sources_num == 0){
+        return;
+      }
+      /* the counts of the chunks take no more space than the edges */
+      chunks_num = (uint32_t) std::min<uint64_t>(runtime.get_workers_num(), edges_num / destinations_num);
+      chunks_num = std::max<uint32_t>(1, std::min(chunks_num, sources_num));
+      chunk_sources.resize(chunks_num + 1);
+      for (uint32_t chunk = 0; chunk < chunks_num; chunk++){
+        index_t first_edge = (index_t) ((uint64_t) edges_num * chunk / chunks_num);
+        
+        chunk_sources[chunk] = std::lower_bound(sources, sources + sources_num, first_edge,
+                                                [](const Outbound_t& source, index_t edge){ return source.index < edge; }) - sources;
+      }
+      chunk_sources[chunks_num] = sources_num;
+      in_counts.assign((size_t) chunks_num * destinations_num, 0);
+      /* count the edges of every chunk per destination */
+      parallel_for<uint32_t>(0, chunks_num, [&](uint32_t chunk){
+        index_t * counts = &in_counts[(size_t) chunk * destinations_num];
+        index_t first_edge = (chunk_sources[chunk] < sources_num) ? sources[chunk_sources[chunk]].index : edges_num;
+        index_t last_edge = (chunk_sources[chunk + 1] < sources_num) ? sources[chunk_sources[chunk + 1]].index : edges_num;
+        
+        for (index_t j = first_edge; j < last_edge; j++){
+          counts[adj[j] - first_vid]++;
+        }
+      }, 1);
+      /* the counts become the first slot of every chunk, in the order of the chunks */
+      parallel_for<uint32_t>(0, destinations_num, [&](uint32_t destination){
+        index_t slot = in_fill[destination];
+        
+        for (uint32_t chunk = 0; chunk < chunks_num; chunk++){
+          index_t count = in_counts[(size_t) chunk * destinations_num + destination];
+          
+          in_counts[(size_t) chunk * destinations_num + destination] = slot;
+          slot += count;
+        }
+        in_fill[destination] = slot;
+      });
+      /* place the edges */
+      parallel_for<uint32_t>(0, chunks_num, [&](uint32_t chunk){
+        index_t * slots = &in_counts[(size_t) chunk * destinations_num];
+        
+        for (uint32_t i = chunk_sources[chunk]; i < chunk_sources[chunk + 1]; i++){
+          index_t last_edge = (i + 1 < sources_num) ? sources[i + 1].index : edges_num;
+          
+          for (index_t j = sources[i].index; j < last_edge; j++){
+            index_t slot = slots[adj[j] - first_vid]++;
+            
+            in_neighbours[slot] = sources[i].vID;
+            in_positions[slot] = first_position + j;
+          }
+        }
+      }, 1);
+    }
+    
+    void set_in_data(EdgeValue * data)
+    {
+      this->in_data = data;
+    }
+    
+    degree_t indegree(vertex_t ID)
+    {
+      return contains(ID) ? in_offsets[ID - first_vid + 1] - in_offsets[ID - first_vid] : 0;
+    }
+    
+    degree_t outdegree(vertex_t ID)
+    {
+      return contains(ID) ? out_degrees[ID - first_vid] : 0;
+    }
+    
+    /* the neighbours of the spans are found in store, the vertices of the program that asks */
+    Span in_span(vertex_t ID, Store * store)
+    {
+      index_t first;
+      
+      if (!contains(ID)){
+        return Span();
+      }
+      first = in_offsets[ID - first_vid];
+      return Span(store, in_neighbours.data() + first, in_positions.data() + first, in_data,
+                  in_offsets[ID - first_vid + 1] - first);
+    }
+    
+    degree_t out_spans_num(vertex_t ID)
+    {
+      return contains(ID) ? out_offsets[ID - first_vid + 1] - out_offsets[ID - first_vid] : 0;
+    }
+    
+    Span out_span(vertex_t ID, index_t index, Store * store)
+    {
+      OutSpan_t& span = out_spans[out_offsets[ID - first_vid] + index];
+      ShardEdges_t<EdgeValue>& edges = shards[span.shardID];
+      index_t offset = span.first_edge - edges.first_edge;
+      
+      return Span(store, edges.adj + offset, NULL, edges.data + offset, span.count);
+    }
+  };
+}
+
+#endif /* interval_edges_hpp */
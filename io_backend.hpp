@@ -0,0 +1,381 @@
+/*
+  io_backend.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef io_backend_hpp
+#define io_backend_hpp
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "log.hpp"
+
+#define IO_URING true           /* read through io_uring if the kernel supports it, with pread otherwise */
+#define IO_QUEUE_DEPTH 64       /* reads in flight */
+#define IO_MAX_READ_BYTES (1L*1024L*1024L*1024L)  /* larger reads are split */
+
+namespace GraphSN {
+
+  /* read queued in a backend */
+  typedef struct ReadRequest_s{
+    int32_t   file;       /* index of the file in the backend */
+    char *    buffer;
+    size_t    bytes;
+    off_t     offset;
+  }ReadRequest_t;
+
+  /*
+      Reads of the shards, the inbound degrees and the edge data. Files are opened once and stay
+      open until close_files. Reads are queued into buffers the caller has allocated and are all
+      completed by complete, so a backend can have them in flight together. Intervals are loaded
+      by one thread, backends are not thread safe.
+  */
+  class IOBackend{
+
+  protected:
+
+    std::map < std::string, int32_t > files;
+    std::vector < int32_t >           fds;
+    std::vector < ReadRequest_t >     queued;
+
+    /* reads every queued request, requests queued meanwhile included */
+    virtual void read_queued() = 0;
+
+    virtual void files_changed(){}
+
+    /* queues what is left of a request after a read of done bytes */
+    void requeue(ReadRequest_t request, size_t done)
+    {
+      if (done == 0){
+        LOG("Unexpected end of file at offset %llu\n", (long long unsigned int) request.offset);
+        exit(EXIT_FAILURE);
+      }
+      if (done < request.bytes){
+        request.buffer += done;
+        request.bytes -= done;
+        request.offset += done;
+        queued.push_back(request);
+      }
+    }
+
+  public:
+
+    virtual ~IOBackend()
+    {
+      for (uint32_t i = 0; i < fds.size(); i++){
+        close(fds[i]);
+      }
+    }
+
+    virtual const char * name() = 0;
+
+    /**
+     * open_file
+     *
+     * @param   filename    name of the file
+     * @return  index of the file, which is opened only the first time
+     */
+    int32_t open_file(std::string filename)
+    {
+      std::map < std::string, int32_t >::iterator file = files.find(filename);
+      int32_t fd;
+
+      if (file != files.end()){
+        return file->second;
+      }
+      fd = open(filename.c_str(), O_RDONLY);
+      if (fd == -1) handle_error(("opening " + filename).c_str());
+      files[filename] = (int32_t) fds.size();
+      fds.push_back(fd);
+      files_changed();
+      return (int32_t) fds.size() - 1;
+    }
+
+    /**
+     * queue
+     *
+     * Queues a read, the buffer is filled when complete returns
+     *
+     * @param   filename    name of the file
+     * @param   buffer      buffer of at least bytes
+     * @param   bytes       bytes to read
+     * @param   offset      offset in the file
+     * @return  void
+     */
+    void queue(std::string filename, void * buffer, size_t bytes, off_t offset)
+    {
+      ReadRequest_t request = {open_file(filename), reinterpret_cast<char*>(buffer), bytes, offset};
+
+      if (bytes != 0){
+        queued.push_back(request);
+      }
+    }
+
+    void complete()
+    {
+      if (!queued.empty()){
+        read_queued();
+        queued.clear();
+      }
+    }
+
+    /* reads completely, together with the reads queued before */
+    void read(std::string filename, void * buffer, size_t bytes, off_t offset)
+    {
+      queue(filename, buffer, bytes, offset);
+      complete();
+    }
+
+    /**
+     * close_files
+     *
+     * Closes the files, e.g. before they are created again
+     *
+     * @return  void
+     */
+    void close_files()
+    {
+      complete();
+      for (uint32_t i = 0; i < fds.size(); i++){
+        close(fds[i]);
+      }
+      fds.clear();
+      files.clear();
+      files_changed();
+    }
+  };
+
+  class PreadBackend: public IOBackend{
+
+    void read_queued()
+    {
+      for (size_t i = 0; i < queued.size(); i++){
+        ReadRequest_t request = queued[i];
+        ssize_t done = pread(fds[request.file], request.buffer, std::min<size_t>(request.bytes, IO_MAX_READ_BYTES), request.offset);
+
+        if (done == -1){
+          if (errno == EINTR){
+            queued.push_back(request);
+            continue;
+          }
+          handle_error("preading");
+        }
+        requeue(request, done);
+      }
+    }
+
+  public:
+
+    const char * name(){ return "pread"; }
+  };
+
+  /*
+      io_uring backend, set up with the raw system calls. The files are registered with the
+      ring, so reads don't look up their descriptors.
+  */
+  class UringBackend: public IOBackend{
+
+    int32_t               ring_fd;
+    uint32_t              entries;
+    bool                  registered;
+    char *                sq_ring, * cq_ring;
+    size_t                sq_ring_bytes, cq_ring_bytes, sqes_bytes;
+    unsigned *            sq_tail, * sq_mask, * sq_array;
+    unsigned *            cq_head, * cq_tail, * cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+
+    UringBackend(): ring_fd(-1), entries(0), registered(false), sq_ring(NULL), cq_ring(NULL), sqes(NULL){}
+
+    bool setup()
+    {
+      struct io_uring_params params;
+
+      memset(&params, 0, sizeof(params));
+      ring_fd = (int32_t) syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+      /* plain reads need Linux 5.6, the first version with IORING_FEAT_RW_CUR_POS */
+      if (ring_fd == -1 || !(params.features & IORING_FEAT_RW_CUR_POS)){
+        return false;
+      }
+      entries = params.sq_entries;
+      sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+      if (params.features & IORING_FEAT_SINGLE_MMAP){
+        sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+      }
+      sq_ring = (char *) mmap(NULL, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+      if (sq_ring == MAP_FAILED){
+        sq_ring = NULL;
+        return false;
+      }
+      if (params.features & IORING_FEAT_SINGLE_MMAP){
+        cq_ring = sq_ring;
+      }
+      else{
+        cq_ring = (char *) mmap(NULL, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED){
+          cq_ring = NULL;
+          return false;
+        }
+      }
+      sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+      sqes = (struct io_uring_sqe *) mmap(NULL, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+      if (sqes == MAP_FAILED){
+        sqes = NULL;
+        return false;
+      }
+      sq_tail  = (unsigned *) (sq_ring + params.sq_off.tail);
+      sq_mask  = (unsigned *) (sq_ring + params.sq_off.ring_mask);
+      sq_array = (unsigned *) (sq_ring + params.sq_off.array);
+      cq_head  = (unsigned *) (cq_ring + params.cq_off.head);
+      cq_tail  = (unsigned *) (cq_ring + params.cq_off.tail);
+      cq_mask  = (unsigned *) (cq_ring + params.cq_off.ring_mask);
+      cqes     = (struct io_uring_cqe *) (cq_ring + params.cq_off.cqes);
+      return true;
+    }
+
+    /* reads use the registered files, or their descriptors if registering fails */
+    void files_changed()
+    {
+      if (registered){
+        syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_FILES, NULL, 0);
+        registered = false;
+      }
+      if (!fds.empty()){
+        registered = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, fds.data(), fds.size()) == 0;
+      }
+    }
+
+    void prepare_read(size_t requestID)
+    {
+      ReadRequest_t& request = queued[requestID];
+      unsigned tail = *sq_tail;
+      unsigned index = tail & *sq_mask;
+      struct io_uring_sqe * sqe = &sqes[index];
+
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = registered ? request.file : fds[request.file];
+      sqe->flags = registered ? IOSQE_FIXED_FILE : 0;
+      sqe->addr = (uint64_t) (uintptr_t) request.buffer;
+      sqe->len = (uint32_t) std::min<size_t>(request.bytes, IO_MAX_READ_BYTES);
+      sqe->off = (uint64_t) request.offset;
+      sqe->user_data = requestID;
+      sq_array[index] = index;
+      /* the kernel sees the entry only after it is written */
+      __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    void read_queued()
+    {
+      size_t next = 0;
+      uint32_t in_flight = 0, unsubmitted = 0;
+
+      while (next < queued.size() || in_flight){
+        unsigned head;
+        int32_t submitted;
+
+        while (next < queued.size() && in_flight < entries){
+          prepare_read(next++);
+          in_flight++;
+          unsubmitted++;
+        }
+        submitted = (int32_t) syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted == -1){
+          /* completions may have to be reaped before more reads are accepted */
+          if (errno != EINTR && errno != EAGAIN && errno != EBUSY) handle_error("submitting reads to io_uring");
+          submitted = 0;
+        }
+        unsubmitted -= submitted;
+        head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)){
+          struct io_uring_cqe * cqe = &cqes[head & *cq_mask];
+          ReadRequest_t request = queued[cqe->user_data];
+
+          if (cqe->res == -EINTR || cqe->res == -EAGAIN){
+            queued.push_back(request);
+          }
+          else if (cqe->res < 0){
+            errno = -cqe->res;
+            handle_error("reading with io_uring");
+          }
+          else{
+            requeue(request, cqe->res);
+          }
+          head++;
+          in_flight--;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+      }
+    }
+
+  public:
+
+    /**
+     * create
+     *
+     * @return  an io_uring backend, or NULL if the kernel doesn't provide one
+     */
+    static UringBackend * create()
+    {
+      UringBackend * backend = new UringBackend();
+
+      if (!backend->setup()){
+        delete backend;
+        return NULL;
+      }
+      return backend;
+    }
+
+    ~UringBackend()
+    {
+      if (sqes){
+        munmap(sqes, sqes_bytes);
+      }
+      if (cq_ring && cq_ring != sq_ring){
+        munmap(cq_ring, cq_ring_bytes);
+      }
+      if (sq_ring){
+        munmap(sq_ring, sq_ring_bytes);
+      }
+      if (ring_fd != -1){
+        close(ring_fd);
+      }
+    }
+
+    const char * name(){ return "io_uring"; }
+  };
+
+  /**
+   * io
+   *
+   * @return  the backend of the engine, created on first use
+   */
+  inline IOBackend& io()
+  {
+    static IOBackend * backend = NULL;
+
+    if (!backend){
+      backend = IO_URING ? UringBackend::create() : NULL;
+      if (!backend){
+        backend = new PreadBackend();
+      }
+      LOG("Reading with %s\n", backend->name());
+    }
+    return *backend;
+  }
+}
+
+#endif /* io_backend_hpp */
@@ -0,0 +1,153 @@
+/*
+  memory_governor.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef memory_governor_hpp
+#define memory_governor_hpp
+
+#include <string>
+#include <fstream>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "log.hpp"
+
+namespace GraphSN {
+  
+  /*
+      One memory budget for the whole engine. Components are placed in the order the engine asks
+      for them, the ones that can be left on disk (adjacency, cache, interval groups) only get
+      what the earlier ones left. The budget is lowered to what is available in the system, so
+      decisions taken later adapt when other processes take memory.
+  */
+  class MemoryGovernor{
+    
+    uint64_t    budget;
+    uint64_t    reserved;     /* bytes of the placed components */
+    
+  public:
+    
+    static uint64_t physical_memory()
+    {
+      return (uint64_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+    }
+    
+    /**
+     * available_memory
+     *
+     * @return  MemAvailable of /proc/meminfo, or the physical memory if it is unknown
+     */
+    static uint64_t available_memory()
+    {
+      std::ifstream meminfo("/proc/meminfo");
+      std::string key;
+      uint64_t kilobytes;
+      
+      while (meminfo >> key >> kilobytes){
+        if (key == "MemAvailable:"){
+          return kilobytes * 1024;
+        }
+        meminfo.ignore(64, '\n');
+      }
+      return physical_memory();
+    }
+    
+    /* a budget of 0 is three quarters of the physical memory */
+    MemoryGovernor(uint64_t budget = 0): budget(budget ? budget : physical_memory() / 4 * 3), reserved(0){}
+    
+    void set_budget(uint64_t budget)
+    {
+      this->budget = budget ? budget : physical_memory() / 4 * 3;
+    }
+    
+    /**
+     * limit
+     *
+     * @return  budget, lowered to the placed components and the memory that is available now
+     */
+    uint64_t limit()
+    {
+      uint64_t available = reserved + available_memory();
+      
+      return (available < budget) ? available : budget;
+    }
+    
+    uint64_t free_bytes()
+    {
+      uint64_t current_limit = limit();
+      
+      return (current_limit > reserved) ? current_limit - reserved : 0;
+    }
+    
+    uint64_t reserved_bytes()
+    {
+      return reserved;
+    }
+    
+    /**
+     * require
+     *
+     * Places a component the engine can't run without, even over the budget
+     *
+     * @param   component   name of the component
+     * @param   bytes       bytes of the component
+     * @return  void
+     */
+    void require(const char * component, uint64_t bytes)
+    {
+      if (bytes > free_bytes()){
+        LOG("Memory budget exceeded by %s, %llu bytes\n", component, (long long unsigned int) bytes);
+      }
+      reserved += bytes;
+    }
+    
+    /**
+     * reserve
+     *
+     * Places a component if it fits in the budget
+     *
+     * @param   component   name of the component
+     * @param   bytes       bytes of the component
+     * @return  true if it was placed
+     */
+    bool reserve(const char * component, uint64_t bytes)
+    {
+      if (bytes > free_bytes()){
+        LOG("%s doesn't fit in the memory budget, %llu bytes\n", component, (long long unsigned int) bytes);
+        return false;
+      }
+      reserved += bytes;
+      return true;
+    }
+    
+    /**
+     * grant
+     *
+     * Places as much of a component as fits in the budget
+     *
+     * @param   component   name of the component
+     * @param   bytes       bytes the component asks for
+     * @return  bytes placed
+     */
+    uint64_t grant(const char * component, uint64_t bytes)
+    {
+      uint64_t free_now = free_bytes();
+      uint64_t granted = (bytes < free_now) ? bytes : free_now;
+      
+      if (granted < bytes){
+        LOG("%s limited to %llu bytes by the memory budget\n", component, (long long unsigned int) granted);
+      }
+      reserved += granted;
+      return granted;
+    }
+    
+    void release(uint64_t bytes)
+    {
+      reserved = (bytes < reserved) ? reserved - bytes : 0;
+    }
+  };
+}
+
+#endif /* memory_governor_hpp */
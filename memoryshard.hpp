@@ -11,30 +11,34 @@
 
 namespace GraphSN {
   
+  template <typename VertexValue, typename EdgeValue>
   class Memoryshard{
     
+    typedef IntervalEdges<VertexValue, EdgeValue> Edges;
+    
     bool            keep_vertices_in_memory;
-    int32_t         fd_edges, edges_read;
+    bool            mapped;         /* the shard and its edge data are mapped, not read */
+    int32_t         edges_read;
     int16_t         memshardID;
-    value_t *       edge_data_arr;
+    EdgeValue *     edge_data_arr;
     vertex_t *      adj_shard_arr;
     DegreeData_t *  inbound_degrees_arr;
     uint32_t        mem_destinations, inbound_edges_read;
     vertex_t        first_vid, last_vid;
     Outbound_t **   outbound_indices_arr;
     Cache *         hCache;
-    GraphVertex *   vertices;
+    Edges *         hEdges;
+    MappedWindow_t  adj_window, edata_window;
     
     /**
      * load_edges
      *
-     * Load in-edges and internal out-edges from memoryshard
+     * Load memoryshard and group its edges by destination, as the in-edges of the interval
      *
      * @return  void
      */
     void load_edges()
     {
-      int32_t fd;
       uint32_t number_of_vertices;
       std::string inbound_degrees_filename = inFolder + "inbound_degrees";
       std::string outbound_filename = inFolder + "Outbound/outbound_indices_";
@@ -42,76 +46,44 @@ namespace GraphSN {
       std::string memshard_edata_filename = std::string(edge_data_filename + std::to_string(memshardID));
       
       if (!keep_vertices_in_memory){
-        /* read inbound degrees */
-        fd = open(inbound_degrees_filename.c_str(), O_RDONLY);
-        if (fd == -1) handle_error(inbound_degrees_filename.c_str());
-        
+        /* inbound degrees and destinations are queued with the windows of the sliding shards */
         inbound_degrees_arr = (DegreeData_t *) realloc(inbound_degrees_arr, mem_destinations * sizeof(DegreeData_t));
-        pread_sys(reinterpret_cast<char*>(&inbound_degrees_arr[0]), mem_destinations * sizeof(DegreeData_t),
-                  inbound_edges_read * sizeof(DegreeData_t), fd);
-        close(fd);
-        
-        /* allocate memory for inbound edges */
-        for (uint32_t i = 0; i < mem_destinations; i++){
-          vertices[inbound_degrees_arr[i].vID].allocateInedges(inbound_degrees_arr[i].degree);
-        }
+        io().queue(inbound_degrees_filename, inbound_degrees_arr, mem_destinations * sizeof(DegreeData_t),
+                   inbound_edges_read * sizeof(DegreeData_t));
         /* load shard (destinations) */
-        adj_shard_arr = (vertex_t *) realloc(adj_shard_arr, edges_read * sizeof(vertex_t));
-        fd = open(memshard_filename.c_str(), O_RDONLY);
-        if (fd == -1) handle_error(("opening "+ memshard_filename).c_str());
-        read_sys(reinterpret_cast<char*>(&adj_shard_arr[0]), edges_read * sizeof(vertex_t), fd);
-        close(fd);
-      }
-      else{
-        for (uint32_t i = inbound_edges_read; i < inbound_edges_read + mem_destinations; i++){
-          vertices[inbound_degrees_arr[i].vID].allocateInedges(inbound_degrees_arr[i].degree);
+        if (mapped){
+          adj_shard_arr = MapWindow<vertex_t>(adj_window, memshard_filename, edges_read, 0, MADV_SEQUENTIAL);
+        }
+        else{
+          adj_shard_arr = (vertex_t *) realloc(adj_shard_arr, edges_read * sizeof(vertex_t));
+          io().queue(memshard_filename, adj_shard_arr, edges_read * sizeof(vertex_t), 0);
         }
       }
-      inbound_edges_read += mem_destinations;
       /* load edges' data */
-      edge_data_arr = (value_t *) realloc(edge_data_arr, edges_read * sizeof(value_t));
-      if (hCache->noCacheMode()){
-        fd_edges = open(memshard_edata_filename.c_str(), O_RDWR, 0777);
-        if (fd_edges == -1) handle_error(("opening "+ memshard_edata_filename).c_str());
-        read_sys(reinterpret_cast<char*>(&edge_data_arr[0]), edges_read * sizeof(value_t), fd_edges);
-        close(fd_edges);
+      if (mapped){
+        /* in-edges read their values in the order of their destinations */
+        edge_data_arr = MapWindow<EdgeValue>(edata_window, memshard_edata_filename, edges_read, 0, MADV_RANDOM);
+      }
+      else if (hCache->noCacheMode()){
+        edge_data_arr = (EdgeValue *) realloc(edge_data_arr, edges_read * sizeof(EdgeValue));
+        io().queue(memshard_edata_filename, edge_data_arr, edges_read * sizeof(EdgeValue), 0);
       }
       else{
-        hCache->search_and_retrieve(memshardID, 0, edges_read * sizeof(value_t), edge_data_arr);
+        edge_data_arr = (EdgeValue *) realloc(edge_data_arr, edges_read * sizeof(EdgeValue));
+        hCache->search_and_retrieve(memshardID, 0, edges_read * sizeof(EdgeValue), edge_data_arr);
       }
+      /* one batch for the whole interval */
+      io().complete();
+      hEdges->reserve_in_edges(keep_vertices_in_memory ? &inbound_degrees_arr[inbound_edges_read] : inbound_degrees_arr,
+                               mem_destinations, edges_read);
+      inbound_edges_read += mem_destinations;
+      edge_tracker.add_window(memshardID, edge_data_arr, edges_read, 0, memshard_edata_filename);
+      hEdges->set_shard(memshardID, adj_shard_arr, edge_data_arr, 0);
       
       number_of_vertices = GetElementsNumber(outbound_filename+std::to_string(memshardID)+".binary", sizeof(Outbound_t));
       
-#pragma omp parallel for
-      for (uint32_t i = 0; i < number_of_vertices; i++){
-        vertex_t source_vid = outbound_indices_arr[memshardID][i].vID;
-        index_t dest_number;
-        index_t j = 0;
-        
-        if (i < number_of_vertices - 1){
-          dest_number = outbound_indices_arr[memshardID][i+1].index;
-        }
-        else{
-          dest_number = edges_read;
-        }
-        j = outbound_indices_arr[memshardID][i].index;
-        if (source_vid >= first_vid && source_vid <= last_vid){
-          while(j < dest_number){
-            vertex_t dest_vid = adj_shard_arr[j];
-            
-            vertices[dest_vid].addInedge(&vertices[source_vid], &edge_data_arr[j]);
-            vertices[source_vid].addOutedge(&vertices[dest_vid], &edge_data_arr[j]);
-            j++;
-          }
-        }
-        else{
-          while(j < dest_number){
-            vertices[adj_shard_arr[j]].addInedge(&vertices[source_vid], &edge_data_arr[j]);
-            j++;
-          }
-        }
-        
-      }
+      hEdges->add_in_edges(outbound_indices_arr[memshardID], number_of_vertices, adj_shard_arr, edges_read, 0);
+      hEdges->set_in_data(edge_data_arr);
     }
     
   public:
@@ -127,6 +99,13 @@ namespace GraphSN {
       return memshardID;
     }
     
+    /* the next iteration starts again from the first shard */
+    void rewind()
+    {
+      memshardID = -1;
+      inbound_edges_read = 0;
+    }
+    
     uint16_t getID()
     {
       return memshardID;
@@ -137,19 +116,27 @@ namespace GraphSN {
       return mem_destinations;
     }
     
-    Memoryshard(Outbound_t ** out, bool keep_vertices_in_memory, Cache * hCache): keep_vertices_in_memory(keep_vertices_in_memory), memshardID(-1),
-    edge_data_arr(NULL), adj_shard_arr(NULL), inbound_degrees_arr(NULL),
-    inbound_edges_read(0), outbound_indices_arr(out), hCache(hCache){}
+    Memoryshard(Outbound_t ** out, bool keep_vertices_in_memory, Cache * hCache, bool mapped = false): keep_vertices_in_memory(keep_vertices_in_memory),
+    mapped(mapped), memshardID(-1), edge_data_arr(NULL), adj_shard_arr(NULL), inbound_degrees_arr(NULL),
+    inbound_edges_read(0), outbound_indices_arr(out), hCache(hCache)
+    {
+      adj_window.buffer = edata_window.buffer = NULL;
+    }
     
     ~Memoryshard()
     {
-      CHECK(edge_data_arr);
+      if (mapped){
+        UnmapWindow(edata_window);
+        if (!keep_vertices_in_memory){
+          UnmapWindow(adj_window);
+          free(inbound_degrees_arr);
+        }
+        return;
+      }
+      /* in groups of intervals the memory shard is never loaded */
       free(edge_data_arr);
       
       if (!keep_vertices_in_memory){
-        CHECK(adj_shard_arr);
-        CHECK(inbound_degrees_arr);
-        
         free(adj_shard_arr);
         free(inbound_degrees_arr);
       }
@@ -168,16 +155,17 @@ namespace GraphSN {
      *
      * @param   membounds         first and last vertex of memoryshard
      * @param   number_of_edges   number of edges in memoryshard
+     * @param   hEdges            edges of the interval
      * @return  void
      */
-    void prepare(Interval_t interval_bounds, uint32_t number_of_edges, GraphVertex * vertices)
+    void prepare(Interval_t interval_bounds, uint32_t number_of_edges, Edges * hEdges)
     {
-      this->vertices                = vertices;
+      this->hEdges                  = hEdges;
       this->edges_read              = number_of_edges;
       this->first_vid               = interval_bounds.first_vid;
       this->last_vid                = interval_bounds.last_vid;
       this->mem_destinations        = interval_bounds.destinations_num;
-      /* load in-edges and internal out-edges */
+      /* load in-edges */
       load_edges();
     }
   };
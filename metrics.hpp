@@ -28,21 +28,23 @@ namespace GraphSN
     return a.size > b.size;
   }
   
+  template <typename VertexValue>
   void AnalyzeConnectedComponents(std::string filename)
   {
     int32_t fd;
     uint32_t counter;
-    value_t previous_label;
-    value_t * vertices_data_arr;
+    VertexValue previous_label;
+    VertexValue * vertices_data_arr;
     std::string metrics_filename;
     std::vector <ConnectedComponents_t> connected_components_vec;
     
     metrics_filename = filename + ".metrics";
     fd = open((inFolder + "vertex_data").c_str(), O_RDONLY);
-    vertices_data_arr = (value_t *) malloc(vertices_number * sizeof(value_t));
-    read_sys(reinterpret_cast<char*> (&vertices_data_arr[0]), vertices_number * sizeof(value_t), fd);
+    vertices_data_arr = (VertexValue *) malloc(vertices_number * sizeof(VertexValue));
+    read_sys(reinterpret_cast<char*> (&vertices_data_arr[0]), vertices_number * sizeof(VertexValue), fd);
+    close(fd);
     
-    std::sort(vertices_data_arr, vertices_data_arr + vertices_number, std::greater<double>());
+    std::sort(vertices_data_arr, vertices_data_arr + vertices_number, std::greater<VertexValue>());
     
     counter = 1;
     previous_label = vertices_data_arr[0];
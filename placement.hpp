@@ -0,0 +1,94 @@
+/*
+  placement.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef placement_hpp
+#define placement_hpp
+
+#include <string>
+#include <fstream>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "log.hpp"
+
+#define NUMA_INTERLEAVE true    /* spread the pages of large arrays over the NUMA nodes */
+#define HUGE_PAGES false        /* back large arrays with transparent huge pages */
+#define LARGE_ARRAY_BYTES (2L*1024L*1024L)    /* smaller arrays keep the default placement */
+#define INTERLEAVE_POLICY 3     /* MPOL_INTERLEAVE of linux/mempolicy.h */
+
+namespace GraphSN {
+
+  /**
+   * numa_nodes
+   *
+   * @return  number of NUMA nodes, 1 if the kernel doesn't report them
+   */
+  inline uint32_t numa_nodes()
+  {
+    static uint32_t nodes = 0;
+
+    if (!nodes){
+      std::ifstream online("/sys/devices/system/node/online");
+      std::string ranges;
+
+      nodes = 1;
+      /* e.g. "0-1" or "0,2-3", nodes are numbered up to the last one */
+      if (online >> ranges){
+        size_t last = ranges.find_last_of(",-");
+
+        nodes = (uint32_t) strtoul(ranges.c_str() + ((last == std::string::npos) ? 0 : last + 1), NULL, 10) + 1;
+      }
+    }
+    return nodes;
+  }
+
+  /**
+   * allocate_array
+   *
+   * Allocates an array that is read by every worker. The pages of large arrays are interleaved
+   * over the NUMA nodes, so that no node serves all the accesses, and with HUGE_PAGES they are
+   * backed by transparent huge pages. Arrays are released with free.
+   *
+   * @param   bytes       bytes of the array
+   * @param   alignment   alignment of small arrays
+   * @return  the array
+   */
+  inline void * allocate_array(size_t bytes, size_t alignment = sizeof(void *))
+  {
+    void * data;
+    size_t page_size = getpagesize();
+    bool large = bytes >= LARGE_ARRAY_BYTES;
+
+    if (large){
+      alignment = HUGE_PAGES ? LARGE_ARRAY_BYTES : page_size;
+    }
+    if (posix_memalign(&data, alignment, bytes ? bytes : 1)) handle_error("allocating array");
+    if (!large){
+      return data;
+    }
+    /* policies are set before the pages are touched, the last page may be shared with other data */
+    bytes = bytes / page_size * page_size;
+    if (HUGE_PAGES && madvise(data, bytes, MADV_HUGEPAGE) == -1){
+      DBG_LOG("Transparent huge pages are not available\n");
+    }
+    if (NUMA_INTERLEAVE && numa_nodes() > 1){
+      unsigned long nodes_mask[16] = {0};
+
+      for (uint32_t node = 0; node < numa_nodes() && node < sizeof(nodes_mask) * 8; node++){
+        nodes_mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+      }
+      if (syscall(SYS_mbind, data, bytes, INTERLEAVE_POLICY, nodes_mask, sizeof(nodes_mask) * 8, 0) == -1){
+        DBG_LOG("Pages of %llu bytes are not interleaved\n", (long long unsigned int) bytes);
+      }
+    }
+    return data;
+  }
+}
+
+#endif /* placement_hpp */
@@ -20,6 +20,8 @@ namespace GraphSN {
   int has_edge_value;
   int chunk_size;
   
+  /* VertexValue and EdgeValue are the types of the vertex and edge data files */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
   class Preprocessing
   {
     
@@ -63,7 +65,7 @@ namespace GraphSN {
       char *src,*vertex;
       char delims[] = "\t, ";
       vertex_t in,out;
-      kway<EdgeWithoutValue_t> hKway;
+      kway<EdgeWithoutValue_t, VertexValue, EdgeValue> hKway;
       
       fd = open(infile, O_RDONLY);
       if (fd == -1)   handle_error("open input file");
@@ -112,7 +114,7 @@ namespace GraphSN {
       char delims[] = "\t, ";
       vertex_t  in,out;
       value_t   edge_value;
-      kway<EdgeWithValue_t> hKway;
+      kway<EdgeWithValue_t, VertexValue, EdgeValue> hKway;
       
       fd = open(infile, O_RDONLY);
       if (fd == -1)   handle_error("open input file");
@@ -173,6 +175,39 @@ namespace GraphSN {
       }
     }
     
+    /**
+     * check_value_widths
+     *
+     * Checks that the vertex and edge data files hold values of VertexValue and EdgeValue
+     *
+     * @param   inFolder name of the initial folder
+     * @return  true if they do
+     */
+    bool check_value_widths(std::string inFolder)
+    {
+      std::ifstream fileShardInfo (inFolder+"shards.info");
+      std::string strVertexData (inFolder+"vertex_data");
+      uint32_t shards, vertices;
+      uint64_t edges, edge_data_bytes = 0;
+      
+      fileShardInfo >> shards >> edges >> vertices;
+      if (!fileShardInfo || !check_file(strVertexData)){
+        return false;
+      }
+      if ((uint64_t) GetFileSize(strVertexData) != (uint64_t) vertices * sizeof(VertexValue)){
+        return false;
+      }
+      for (uint32_t shard = 0; shard < shards; shard++){
+        std::string strEdgeData (inFolder+"EdgeData/edgedata_"+std::to_string(shard));
+        
+        if (!check_file(strEdgeData)){
+          return false;
+        }
+        edge_data_bytes += GetFileSize(strEdgeData);
+      }
+      return edge_data_bytes == edges * sizeof(EdgeValue);
+    }
+    
   public:
     
     /**
@@ -221,6 +256,11 @@ namespace GraphSN {
         LOG("Intervals file is missing!\n");
         goto Parse;
       }
+      /* vertex and edge data are written again when the types of the values change */
+      if (!check_value_widths(inFolder)){
+        LOG("Vertex or edge data have a different width!\n");
+        goto Parse;
+      }
       LOG("Using shards/intervals from previous run!\n");
       return;
     Parse:
@@ -7,59 +7,225 @@
 #ifndef scheduler_hpp
 #define scheduler_hpp
 
+#include <mutex>
 #include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
 #include "types.hpp"
+#include "task_runtime.hpp"
+#include "vertex_values.hpp"    /* CACHE_LINE_SIZE */
+
+#define SPARSE_FRONTIER_DIVISOR 64    /* frontiers of at most 1/64 of the vertices are kept as lists too */
 
 namespace GraphSN {
-  
+
+  /*
+      Vertices scheduled for the current and the next iteration, as bitmaps of 64 bit words that
+      are updated atomically, so add_task may be called by concurrent updates. A vertex scheduled
+      for the next iteration is also queued by the thread that set its bit, in a queue of its own.
+      If the next frontier turns out to be sparse, swap sorts the queues into a list, and the
+      current frontier is visited through the list instead of the words. The tasks of every
+      interval of the current frontier are counted, so intervals without tasks are skipped.
+  */
   class Scheduler{
-    
-    std::vector<bool> current_bitscheduler;
-    std::vector<bool> next_bitscheduler;
-    
+
+    /* tasks queued by a thread for the next iteration */
+    typedef struct Queued_s{
+      std::vector<vertex_t> * queue;
+      int64_t                 count;      /* bits of the next frontier set minus bits cleared */
+      bool                    overflow;   /* the queue holds only part of the tasks */
+    }Queued_t;
+
+    union Slot_t{
+      Queued_t  tasks;
+      char      line[((sizeof(Queued_t) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE];
+    };
+
+    uint64_t                  vertices_num;
+    uint64_t *                current_words, * next_words;
+    uint64_t                  words_num;
+    std::vector<vertex_t>     frontier;         /* sorted current tasks, if sparse */
+    std::vector<Interval_t>   intervals;
+    std::vector<uint64_t>     interval_tasks;   /* current tasks of every interval */
+    uint32_t                  slots_num;
+    Slot_t *                  slots;          /* slot 0 belongs to threads outside the runtime */
+    std::mutex                external_mtx;
+    bool                      sparse;
+    bool                      synchronous;
+
+    static uint64_t bit(vertex_t ID)
+    {
+      return 1ULL << (ID % 64);
+    }
+
+    uint64_t sparse_limit()
+    {
+      return vertices_num / SPARSE_FRONTIER_DIVISOR;
+    }
+
+    uint16_t interval_of(vertex_t ID)
+    {
+      uint16_t low = 0, high = (uint16_t) (intervals.size() - 1);
+
+      while (low < high){
+        uint16_t middle = (low + high + 1) / 2;
+
+        if (intervals[middle].first_vid <= ID){
+          low = middle;
+        }
+        else{
+          high = middle - 1;
+        }
+      }
+      return low;
+    }
+
+    /* slot of the calling thread, the lock is held for threads outside the runtime */
+    Queued_t& queued(std::unique_lock<std::mutex>& lock)
+    {
+      int32_t workerID = TaskRuntime::worker_id();
+
+      if (workerID >= 0 && (uint32_t) workerID + 1 < slots_num){
+        return slots[workerID + 1].tasks;
+      }
+      lock = std::unique_lock<std::mutex>(external_mtx);
+      return slots[0].tasks;
+    }
+
+    uint64_t count_tasks(uint64_t * words, vertex_t fromID, vertex_t toID)
+    {
+      uint64_t tasks = 0;
+
+      for (uint64_t word = fromID / 64; word <= toID / 64; word++){
+        uint64_t mask = ~0ULL;
+
+        if (word == fromID / 64){
+          mask &= ~0ULL << (fromID % 64);
+        }
+        if (word == toID / 64 && toID % 64 != 63){
+          mask &= (1ULL << (toID % 64 + 1)) - 1;
+        }
+        tasks += __builtin_popcountll(words[word] & mask);
+      }
+      return tasks;
+    }
+
+    /* the current frontier is kept as words only, e.g. after bits were set outside add_task */
+    void count_current()
+    {
+      sparse = false;
+      frontier.clear();
+      parallel_for<uint32_t>(0, (uint32_t) intervals.size(), [&](uint32_t interval){
+        interval_tasks[interval] = count_tasks(current_words, intervals[interval].first_vid, intervals[interval].last_vid);
+      }, 1);
+    }
+
+    void reset_slots(bool overflow)
+    {
+      for (uint32_t i = 0; i < slots_num; i++){
+        slots[i].tasks.queue->clear();
+        slots[i].tasks.count = 0;
+        slots[i].tasks.overflow = overflow;
+      }
+    }
+
   public:
-    
-    bool has_tasks;
-    
-    Scheduler(size_t size)
+
+    bool has_tasks;   /* the current frontier has tasks, set by swap */
+
+    Scheduler(size_t size): vertices_num(size), words_num((size + 63) / 64), slots_num(runtime.get_workers_num() + 1), sparse(false),
+    synchronous(false), has_tasks(true)
     {
-      current_bitscheduler.resize(size,true);
-      next_bitscheduler.resize(size,false);
-      has_tasks = true;
+      Interval_t all = {0, (vertex_t) (size ? size - 1 : 0), (uint32_t) size};
+
+      current_words = new uint64_t[words_num ? words_num : 1]();
+      next_words = new uint64_t[words_num ? words_num : 1]();
+      if (posix_memalign(reinterpret_cast<void **>(&slots), CACHE_LINE_SIZE, slots_num * sizeof(Slot_t))){
+        handle_error("allocating scheduler slots");
+      }
+      for (uint32_t i = 0; i < slots_num; i++){
+        slots[i].tasks.queue = new std::vector<vertex_t>();
+      }
+      reset_slots(false);
+      /* every vertex runs in the first iteration */
+      memset(current_words, 0xff, words_num * sizeof(uint64_t));
+      if (size % 64){
+        current_words[words_num - 1] = bit((vertex_t) size) - 1;
+      }
+      intervals.push_back(all);
+      interval_tasks.assign(1, size);
     }
-    
-    
+
     ~Scheduler()
     {
-      current_bitscheduler.clear();
-      current_bitscheduler.shrink_to_fit();
-      next_bitscheduler.clear();
-      next_bitscheduler.shrink_to_fit();
+      for (uint32_t i = 0; i < slots_num; i++){
+        delete slots[i].tasks.queue;
+      }
+      free(slots);
+      delete [] current_words;
+      delete [] next_words;
+    }
+
+    /**
+     * set_intervals
+     *
+     * Sets the intervals whose tasks are counted
+     *
+     * @param   intervals   intervals of the graph
+     * @return  void
+     */
+    void set_intervals(const std::vector<Interval_t>& intervals)
+    {
+      this->intervals = intervals;
+      interval_tasks.assign(intervals.size(), 0);
+      count_current();
     }
-    
+
     void add_task(vertex_t id, bool current_iteration = false)
     {
-      next_bitscheduler[id] = true;
-      if (current_iteration){
-        current_bitscheduler[id] = true;
+      uint64_t previous = __atomic_fetch_or(&next_words[id / 64], bit(id), __ATOMIC_RELAXED);
+
+      if (!(previous & bit(id))){
+        std::unique_lock<std::mutex> lock;
+        Queued_t& own = queued(lock);
+
+        own.count++;
+        if (own.queue->size() < sparse_limit()){
+          own.queue->push_back(id);
+        }
+        else{
+          own.overflow = true;
+        }
+      }
+      /* in synchronous mode a vertex never runs twice in the same iteration */
+      if (current_iteration && !synchronous){
+        previous = __atomic_fetch_or(&current_words[id / 64], bit(id), __ATOMIC_RELAXED);
+        if (!(previous & bit(id))){
+          /* the list misses the vertex, the rest of the iteration reads the words */
+          __atomic_store_n(&sparse, false, __ATOMIC_RELAXED);
+          __atomic_fetch_add(&interval_tasks[interval_of(id)], 1, __ATOMIC_RELAXED);
+        }
       }
-      has_tasks = true;
     }
-    
-    void clear(std::vector<bool>& scheduler, uint32_t fromID, uint32_t toID)
+
+    void set_synchronous(bool synchronous)
     {
-      CHECK(fromID <= scheduler.size());
-      CHECK(fromID <= toID);
-      CHECK(toID   <= scheduler.size());
-      std::fill(scheduler.begin() + fromID, scheduler.begin() + toID + 1, false);
+      this->synchronous = synchronous;
     }
-    
+
     void remove_task(vertex_t ID)
     {
-      CHECK(ID < next_bitscheduler.size());
-      next_bitscheduler[ID] = false;
+      CHECK(ID < vertices_num);
+      if (__atomic_fetch_and(&next_words[ID / 64], ~bit(ID), __ATOMIC_RELAXED) & bit(ID)){
+        std::unique_lock<std::mutex> lock;
+
+        /* the vertex stays queued, swap skips it */
+        queued(lock).count--;
+      }
     }
-    
+
     /**
      * remove_tasks_in_range
      *
@@ -69,45 +235,202 @@ namespace GraphSN {
      */
     void remove_tasks_in_range(vertex_t fromID, vertex_t toID)
     {
-      clear(next_bitscheduler, fromID, toID);
+      CHECK(fromID <= toID);
+      CHECK(toID < vertices_num);
+      for (vertex_t ID = fromID; ID <= toID; ID++){
+        remove_task(ID);
+      }
+    }
+
+    uint64_t get_tasks_num()
+    {
+      uint64_t tasks_num = 0;
+
+      for (uint32_t i = 0; i < interval_tasks.size(); i++){
+        tasks_num += __atomic_load_n(&interval_tasks[i], __ATOMIC_RELAXED);
+      }
+      return tasks_num;
     }
-    
-    uint32_t get_tasks_num()
+
+    /**
+     * get_tasks_num
+     *
+     * @param   fromID  first vertex of an interval
+     * @param   toID    last vertex of an interval, maybe a later one
+     * @return  number of current tasks of the intervals
+     */
+    uint64_t get_tasks_num(vertex_t fromID, vertex_t toID)
     {
-      uint32_t tasks_num = 0;
-      for (vertex_t i = 0; i <= current_bitscheduler.size(); i++){
-        tasks_num += current_bitscheduler[i];
+      uint64_t tasks_num = 0;
+
+      for (uint16_t i = interval_of(fromID); i <= interval_of(toID); i++){
+        tasks_num += __atomic_load_n(&interval_tasks[i], __ATOMIC_RELAXED);
       }
       return tasks_num;
     }
-    
+
     bool is_scheduled(vertex_t index)
     {
-      return current_bitscheduler[index];
+      return __atomic_load_n(&current_words[index / 64], __ATOMIC_RELAXED) & bit(index);
+    }
+
+    bool is_sparse()
+    {
+      return __atomic_load_n(&sparse, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * for_each_task
+     *
+     * Calls function in parallel for the current tasks in [fromID, toID], through the list of a
+     * sparse frontier or the words of a dense one. Every word is visited by one thread.
+     *
+     * @param   fromID      first vertex
+     * @param   toID        last vertex
+     * @param   function    called with the ID of every task
+     * @return  void
+     */
+    template <typename Function>
+    void for_each_task(vertex_t fromID, vertex_t toID, Function function)
+    {
+      if (get_tasks_num(fromID, toID) == 0){
+        return;
+      }
+      if (is_sparse()){
+        uint64_t first = std::lower_bound(frontier.begin(), frontier.end(), fromID) - frontier.begin();
+        uint64_t last = std::upper_bound(frontier.begin(), frontier.end(), toID) - frontier.begin();
+
+        parallel_for<uint64_t>(first, last, [&](uint64_t i){
+          function(frontier[i]);
+        });
+        return;
+      }
+      parallel_for<uint64_t>(fromID / 64, toID / 64 + 1, [&](uint64_t word){
+        uint64_t bits = __atomic_load_n(&current_words[word], __ATOMIC_RELAXED);
+
+        while (bits){
+          vertex_t ID = (vertex_t) (word * 64 + __builtin_ctzll(bits));
+
+          bits &= bits - 1;
+          if (ID >= fromID && ID <= toID){
+            function(ID);
+          }
+        }
+      });
     }
-    
+
+    /**
+     * swap
+     *
+     * The next frontier becomes the current one. Only the words of a sparse frontier are cleared,
+     * and the tasks of a sparse next frontier are sorted into a list.
+     *
+     * @return  void
+     */
     void swap()
     {
-      current_bitscheduler.swap(next_bitscheduler);
-      clear(next_bitscheduler, 0, (uint32_t) next_bitscheduler.size() - 1);
+      int64_t next_tasks = 0;
+      bool listed = true;
+
+      if (sparse){
+        for (uint64_t i = 0; i < frontier.size(); i++){
+          current_words[frontier[i] / 64] = 0;
+        }
+      }
+      else{
+        memset(current_words, 0, words_num * sizeof(uint64_t));
+      }
+      std::swap(current_words, next_words);
+      for (uint32_t i = 0; i < slots_num; i++){
+        next_tasks += slots[i].tasks.count;
+        listed = listed && !slots[i].tasks.overflow;
+      }
+      /* derived here, so concurrent add_task calls never write a shared flag */
+      has_tasks = next_tasks > 0;
+      if (!listed || (uint64_t) next_tasks > sparse_limit()){
+        reset_slots(false);
+        count_current();
+        return;
+      }
+      frontier.clear();
+      for (uint32_t i = 0; i < slots_num; i++){
+        frontier.insert(frontier.end(), slots[i].tasks.queue->begin(), slots[i].tasks.queue->end());
+      }
+      reset_slots(false);
+      std::sort(frontier.begin(), frontier.end());
+      /* removed tasks are still queued, removed and added ones are queued twice */
+      frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+      frontier.erase(std::remove_if(frontier.begin(), frontier.end(), [this](vertex_t ID){ return !is_scheduled(ID); }),
+                     frontier.end());
+      std::fill(interval_tasks.begin(), interval_tasks.end(), 0);
+      for (uint64_t i = 0; i < frontier.size(); i++){
+        interval_tasks[interval_of(frontier[i])]++;
+      }
+      sparse = true;
+    }
+
+    /**
+     * serialize
+     *
+     * Packs both bitschedulers, 8 vertices per byte, followed by has_tasks
+     *
+     * @return  packed state
+     */
+    std::vector<uint8_t> serialize()
+    {
+      size_t bytes = (vertices_num + 7) / 8;
+      std::vector<uint8_t> buffer(2 * bytes + 1, 0);
+
+      for (size_t i = 0; i < bytes; i++){
+        buffer[i] = (uint8_t) (current_words[i / 8] >> (i % 8 * 8));
+        buffer[bytes + i] = (uint8_t) (next_words[i / 8] >> (i % 8 * 8));
+      }
+      buffer[2 * bytes] = has_tasks;
+      return buffer;
+    }
+
+    /**
+     * deserialize
+     *
+     * Restores the state packed by serialize
+     *
+     * @param   buffer  packed state
+     * @return  void
+     */
+    void deserialize(const std::vector<uint8_t>& buffer)
+    {
+      size_t bytes = (vertices_num + 7) / 8;
+
+      CHECK(buffer.size() == 2 * bytes + 1);
+      memset(current_words, 0, words_num * sizeof(uint64_t));
+      memset(next_words, 0, words_num * sizeof(uint64_t));
+      for (size_t i = 0; i < bytes; i++){
+        current_words[i / 8] |= (uint64_t) buffer[i] << (i % 8 * 8);
+        next_words[i / 8] |= (uint64_t) buffer[bytes + i] << (i % 8 * 8);
+      }
+      has_tasks = buffer[2 * bytes];
+      count_current();
+      /* the next tasks are not queued, the next frontier is dense */
+      reset_slots(true);
+      slots[0].tasks.count = (int64_t) count_tasks(next_words, 0, (vertex_t) (vertices_num ? vertices_num - 1 : 0));
     }
-    
+
     /* for debug purposes */
     void print_vectors()
     {
-      for (uint32_t i = 0; i < current_bitscheduler.size(); i++){
-        std::cout << current_bitscheduler[i] << " ";
+      for (vertex_t i = 0; i < vertices_num; i++){
+        std::cout << is_scheduled(i) << " ";
       }
       std::cout << std::endl;
-      for (uint32_t i = 0; i < next_bitscheduler.size(); i++){
-        std::cout << next_bitscheduler[i] << " ";
+      for (vertex_t i = 0; i < vertices_num; i++){
+        std::cout << ((next_words[i / 64] & bit(i)) != 0) << " ";
       }
       std::cout << std::endl;
     }
-    
+
   };
-  
-  
+
+
 }
 
 #endif /* scheduler_hpp */
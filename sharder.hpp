@@ -214,11 +214,11 @@ namespace GraphSN {
    * @param   shard_id          ID of shard
    * @return  void
    */
-  template <typename EdgeType>
+  template <typename EdgeType, typename EdgeValue>
   static void sort_shard(std::vector<EdgeType>& shard_edges,
                          const uint32_t first_index,const uint32_t number_of_edges,const uint32_t shard_id)
   {
-    std::vector <value_t>     edge_data_vec;
+    std::vector <EdgeValue>   edge_data_vec;
     std::vector <vertex_t>    adj_shard_vec;
     std::vector <Outbound_t>  outbound_vec;
     
@@ -228,7 +228,7 @@ namespace GraphSN {
     /* convert the shard to adjacency format */
     convert_adjacency_shard<EdgeType>(shard_edges, first_index, number_of_edges, adj_shard_vec, outbound_vec);
     
-    /* crete edge data */
+    /* crete edge data, converted to the width of EdgeValue */
     edge_data_vec.resize(number_of_edges);
     if (sizeof(EdgeType) == sizeof(EdgeWithValue_t)){
       size_t offset = 2 * sizeof(vertex_t);
@@ -238,18 +238,18 @@ namespace GraphSN {
         value_t current_value;
         
         memcpy(&current_value,(char *)&shard_edges[index] + offset, membytes);
-        edge_data_vec[index - first_index] = current_value;
+        edge_data_vec[index - first_index] = (EdgeValue) current_value;
       }
     }
     else{
       DBG_LOG("No edge data found, filling with 0\n");
-      std::fill(edge_data_vec.begin(), edge_data_vec.end(), 0);
+      std::fill(edge_data_vec.begin(), edge_data_vec.end(), EdgeValue());
     }
     
     /* write everything on disk */
     write_outbound_indices(&outbound_vec[0], (index_t)outbound_vec.size(), shard_id);
     write_shard(reinterpret_cast<char*>(adj_shard_vec.data()), number_of_edges * sizeof(vertex_t), shard_id);
-    write_edge_data(reinterpret_cast<char*>(edge_data_vec.data()), number_of_edges * sizeof(value_t), shard_id);
+    write_edge_data(reinterpret_cast<char*>(edge_data_vec.data()), number_of_edges * sizeof(EdgeValue), shard_id);
     
     edge_data_vec.shrink_to_fit();
   }
@@ -263,31 +263,23 @@ namespace GraphSN {
    * @param   intervals     vector of intervals with vertices
    * @return  void
    */
-  template <typename EdgeType>
+  template <typename EdgeType, typename EdgeValue>
   static void init_sharding(std::vector<EdgeType>& sorted_edges,std::vector<uint32_t> edges_in_intervals){
-    std::thread * sharding_threads = new std::thread[NUMBER_OF_THREADS];
+    TaskGroup sharding_tasks;
     std::ofstream infoshard_file(inFolder+"shards.info",std::ofstream::binary);
-    uint16_t threads_used = 0;
     uint32_t current_interval;
     uint64_t edges_sharded = 0;
     
-    DBG_LOG("Number of sharding threads = %u\n",NUMBER_OF_THREADS);
+    DBG_LOG("Number of sharding workers = %u\n",runtime.get_workers_num());
     for (current_interval = 0; current_interval < (uint32_t) edges_in_intervals.size(); current_interval++){
-      //if we have assigned a task to every thread, wait for them to end before reassigning.
-      if (threads_used == NUMBER_OF_THREADS){
-        for (uint16_t i = 0; i < NUMBER_OF_THREADS; i++){
-          sharding_threads[i].join();
-        }
-        threads_used = 0;
-      }
+      uint32_t first_index = (uint32_t) edges_sharded;
+      uint32_t number_of_edges = edges_in_intervals[current_interval];
+      
       DBG_LOG("Interval %u has %u edges\n",current_interval,edges_in_intervals[current_interval]);
-      sharding_threads[threads_used] = std::thread(sort_shard<EdgeType>,
-                                                   std::ref(sorted_edges),
-                                                   edges_sharded,
-                                                   edges_in_intervals[current_interval],
-                                                   current_interval);
+      sharding_tasks.run([&sorted_edges, first_index, number_of_edges, current_interval](){
+        sort_shard<EdgeType, EdgeValue>(sorted_edges, first_index, number_of_edges, current_interval);
+      });
       edges_sharded += edges_in_intervals[current_interval];
-      threads_used++;
     }
     
     /* write to file the number of shards */
@@ -295,13 +287,9 @@ namespace GraphSN {
     infoshard_file << (uint32_t) current_interval << '\n';
     infoshard_file.close();
     
-    /*Joing sharding threads and deleting the allocated memory*/
-    for (uint16_t i = 0; i < threads_used; i++){
-      sharding_threads[i].join();
-    }
+    /* wait for every shard to be written */
+    sharding_tasks.wait();
     LOG("Sharding Ended\n");
-    
-    delete [] sharding_threads;
   }
   
   /**
@@ -342,13 +330,13 @@ namespace GraphSN {
    * @param   max_dst       max vertex destination id
    * @return  void
    */
-  template<typename EdgeType>
+  template<typename EdgeType, typename VertexValue>
   static void calc_number_of_vertices(std::vector <EdgeType>& sorted_edges,
                                       std::vector <uint32_t> edges_in_intervals, vertex_t max_dst)
   {
     vertex_t        max, last_vertex_index;
     std::ofstream   infoshard_file(inFolder + "shards.info", std::ofstream::binary | std::ofstream::app);
-    value_t *       arrData;
+    VertexValue *   arrData;
     
     max = max_dst;
     last_vertex_index = 0;
@@ -360,8 +348,8 @@ namespace GraphSN {
     }
     vertices_number = max + 1;
     /* write vertices with their values to file */
-    arrData = (value_t *) calloc(vertices_number, sizeof(value_t));
-    write_vertex_data(reinterpret_cast <char * > (&arrData[0]), vertices_number * sizeof(value_t));
+    arrData = (VertexValue *) calloc(vertices_number, sizeof(VertexValue));
+    write_vertex_data(reinterpret_cast <char * > (&arrData[0]), vertices_number * sizeof(VertexValue));
     free(arrData);
     
     CHECK(infoshard_file.is_open());
@@ -380,7 +368,7 @@ namespace GraphSN {
    * @param   sorted_edges  vector with sorted edges
    * @return  void
    */
-  template <typename EdgeType>
+  template <typename EdgeType, typename VertexValue, typename EdgeValue>
   void CalculateIntervals(std::vector <EdgeType>& sorted_edges){
     
     index_t last_index_added = 0;
@@ -441,11 +429,11 @@ namespace GraphSN {
     timer.end("Creating Intervals");
     
     timer.start("Sharding");
-    init_sharding(sorted_edges,edges_in_intervals);
+    init_sharding<EdgeType, EdgeValue>(sorted_edges,edges_in_intervals);
     timer.end("Sharding");
     
     timer.start("Calculating vertices number");
-    calc_number_of_vertices(sorted_edges, edges_in_intervals, max_dst);
+    calc_number_of_vertices<EdgeType, VertexValue>(sorted_edges, edges_in_intervals, max_dst);
     intervals[intervals_number - 1].last_vid = vertices_number - 1;
     timer.end("Calculating vertices number");
     
@@ -6,26 +6,39 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "timer.hpp"
 #include "preprocessing.hpp"
 #include "graph_engine.hpp"
 #include "scheduler.hpp"
 #include "metrics.hpp"
-#include <mutex>
 
 using namespace GraphSN;
 
-uint32_t * values;
-value_t distance;
-vertex_t startID = 1, endID = 364; /* 828323->772159 */
-std::mutex mtx;
+typedef vertex_t  VertexValue;  /* label of the search that reached the vertex, -1 if none */
+typedef float     EdgeValue;    /* not used by the algorithm */
 
-class ShortestDistance : public GraphSNProgram{
+/* one query of the batch */
+class ShortestDistance final : public GraphSNProgram<VertexValue, EdgeValue>{
   
-  bool end = false;
+  uint32_t * values;
+  /* lengths of the paths found where the two searches meet */
+  Aggregator<value_t, MinMonoid<value_t> > * paths;
   
-  void update(GraphVertex& vertex, GraphBox& graphbox) {
+public:
+  
+  vertex_t startID, endID;
+  value_t distance;
+  
+  ShortestDistance(vertex_t startID, vertex_t endID): values(NULL), paths(NULL), startID(startID), endID(endID), distance(-1){}
+  
+  ~ShortestDistance()
+  {
+    free(values);
+  }
+  
+  void update(Vertex& vertex, GraphBox& graphbox) {
     graphbox.scheduler->remove_task(vertex.getID());
     
     if (graphbox.get_current_iteration() == 0){
@@ -39,23 +52,21 @@ class ShortestDistance : public GraphSNProgram{
       return;
     }
     
-    value_t label = vertex.getData();
+    VertexValue label = vertex.getData();
     uint32_t value = values[vertex.getID()];
     
-    for (uint32_t i = 0; i < vertex.num_edges(); i++){
-      value_t data = vertex.edge(i).getVertex()->getData();
-      if (data == -1){
-        values[vertex.edge(i).getID()] = value + 1;
-        vertex.edge(i).getVertex()->setData(label);
-        graphbox.scheduler->add_task(vertex.edge(i).getID());
-      }
-      else if (data != label){
-        end = true;
-        mtx.lock();
-        if (distance == -1){
-          distance = value + values[vertex.edge(i).getID()] + 1;
+    for (uint32_t s = 0; s < vertex.edgeSpans(); s++){
+      Span edges = vertex.edgeSpan(s);
+      for (uint32_t i = 0; i < edges.size(); i++){
+        VertexValue data = -1;
+        /* only one of the vertices that reach an unvisited neighbour labels it */
+        if (edges.getVertex(i)->compareAndSwapData(data, label)){
+          values[edges.getID(i)] = value + 1;
+          graphbox.scheduler->add_task(edges.getID(i));
+        }
+        else if (data != label){
+          paths->add(value + values[edges.getID(i)] + 1);
         }
-        mtx.unlock();
       }
     }
 
@@ -69,16 +80,19 @@ class ShortestDistance : public GraphSNProgram{
       values = (uint32_t *) calloc(vertices_number, sizeof(uint32_t));
       distance = -1;
     }
+    paths = graphbox.min_aggregator<value_t>("paths");
   }
   
   /**
    * Called after an iteration has finished.
    */
   void after_iteration(GraphBox& graphbox) {
-    if (end) {
+    if (paths->get() < std::numeric_limits<value_t>::max()) {
+      distance = paths->get();
       println("Last iteration set!");
       graphbox.set_last_iteration(graphbox.get_current_iteration());
       free(values);
+      values = NULL;
     }
     else{
       println("End of iteration %u/%u\n",graphbox.get_current_iteration(), graphbox.get_iterations_num() - 1);
@@ -107,9 +121,11 @@ int main(int argc, const char * argv[]) {
   uint64_t cache_size;
   
   std::cout << "Shortest distance" << std::endl;
-  ShortestDistance program;
-  Engine * engine;
-  Preprocessing hPreprocessing;
+  /* 828323->772159 */
+  std::vector < std::pair<vertex_t, vertex_t> > queries = {{1, 364}, {0, 4038}, {107, 3980}};
+  std::vector < ShortestDistance * > programs;
+  Engine<VertexValue, EdgeValue> * engine;
+  Preprocessing<VertexValue, EdgeValue> hPreprocessing;
   std::string cache_type = "Indegree";
   
   timer.start("Main execution");
@@ -118,15 +134,22 @@ int main(int argc, const char * argv[]) {
   
   GraphSNInit(argc, argv);
   hPreprocessing.CheckPreprocessing(inFolder);
-  engine = new Engine();
-  engine->run(program, iterations, cache_size, cache_type);
+  engine = new Engine<VertexValue, EdgeValue>();
+  for (uint32_t i = 0; i < queries.size(); i++){
+    programs.push_back(new ShortestDistance(queries[i].first, queries[i].second));
+  }
+  /* the queries share the passes over the shards */
+  engine->run<ShortestDistance>(programs, iterations, cache_size, cache_type);
   timer.end("Main execution");
   
-  if (distance == -1){
-    LOG("There is no path between %u and %u\n",startID, endID);
-  }
-  else{
-    LOG("Shortest path between %u and %u is %f\n",startID, endID, distance);
+  for (uint32_t i = 0; i < programs.size(); i++){
+    if (programs[i]->distance == -1){
+      LOG("There is no path between %u and %u\n",programs[i]->startID, programs[i]->endID);
+    }
+    else{
+      LOG("Shortest path between %u and %u is %f\n",programs[i]->startID, programs[i]->endID, programs[i]->distance);
+    }
+    delete programs[i];
   }
   timer.print_timing_report();
   
@@ -11,18 +11,25 @@
 
 namespace GraphSN {
   
+  template <typename VertexValue, typename EdgeValue>
   class Slidingshard{
     
+    typedef IntervalEdges<VertexValue, EdgeValue> Edges;
+    
     bool            keep_vertices_in_memory;
-    int32_t         fd_edges, first_index, last_index, edges_read;  /* first_index and last_index are the bounds of the sliding window */
+    bool            mapped;         /* windows are mapped, not read */
+    int32_t         first_index, last_index, edges_read;  /* first_index and last_index are the bounds of the sliding window */
+    int32_t         sources_num, cursor;    /* the next window starts at outbound index cursor or later */
     int16_t         shardID;
-    value_t *       edge_data_arr;
+    EdgeValue *     edge_data_arr;
     vertex_t *      adj_shard_arr;
     vertex_t        memshard_firstID, memshard_lastID;
     uint32_t        edge_number_offset;
-    GraphVertex *   vertices;
+    Edges *         hEdges;
     Cache *         hCache;
     Outbound_t **   outbound_indices_arr;
+    MappedWindow_t  adj_window, edata_window;
+    int64_t         cursor_lastID;      /* last vertex of the interval of the previous window, -1 if none */
     
     /**
      * load_edges
@@ -34,18 +41,20 @@ namespace GraphSN {
      */
     void load_edges(uint32_t number_of_edges)
     {
-      std::unordered_map <uint32_t, uint32_t> inbound_degrees;
-      int32_t     fd, number_of_vertices, index, offset;
-      std::string outbound_filename = inFolder + "Outbound/outbound_indices_";
+      int32_t     index, offset;
       std::string slidshard_filename = shard_filename + std::to_string(shardID);
       std::string slidshard_edata_filename = std::string(edge_data_filename + std::to_string(shardID));
       
       first_index = last_index = -1;
       edges_read = -1;
-      number_of_vertices = GetElementsNumber(outbound_filename+std::to_string(shardID)+".binary", sizeof(Outbound_t));
-      index = 0;
+      /* windows of consecutive intervals follow each other, the scan continues from the previous one */
+      if (cursor_lastID >= 0 && memshard_firstID <= (vertex_t) cursor_lastID){
+        cursor = 0;
+      }
+      cursor_lastID = memshard_lastID;
+      index = cursor;
       /* first, we need to properly find the number of bytes we need to load from this shard */
-      while(index < number_of_vertices){
+      while(index < sources_num){
         if (outbound_indices_arr[shardID][index].vID < memshard_firstID){
           index++;
           continue;
@@ -58,15 +67,17 @@ namespace GraphSN {
       }
       /* in case first_index = -1, there is no outbound edges to load */
       if (first_index == -1){
+        cursor = index;
         return;
       }
-      while(index < number_of_vertices){
+      while(index < sources_num){
         if (outbound_indices_arr[shardID][index].vID > memshard_lastID){
           edges_read = outbound_indices_arr[shardID][index].index - outbound_indices_arr[shardID][first_index].index;
           break;
         }
         index++;
       }
+      cursor = index;
       /* in case that edges_read = -1, we reached end of file and we have to set the correct value */
       if (edges_read == - 1){
         edges_read = number_of_edges - outbound_indices_arr[shardID][first_index].index;
@@ -74,63 +85,57 @@ namespace GraphSN {
       last_index = index - 1;
       edge_number_offset = outbound_indices_arr[shardID][first_index].index;
       
-      if (!keep_vertices_in_memory){
+      /* windows are read together with the memory shard, the arrays are only filled then */
+      if (!keep_vertices_in_memory && mapped){
+        adj_shard_arr = MapWindow<vertex_t>(adj_window, slidshard_filename, edges_read, edge_number_offset, MADV_SEQUENTIAL);
+      }
+      else if (!keep_vertices_in_memory){
         /* at this point we know how many edges we will need to load from shard */
         adj_shard_arr = (vertex_t *) realloc(adj_shard_arr, edges_read * sizeof(vertex_t));
-        fd = open(slidshard_filename.c_str(), O_RDONLY);
-        if (fd == -1) handle_error(("opening " + slidshard_filename).c_str());
-        pread_sys(reinterpret_cast<char*>(&adj_shard_arr[0]), edges_read * sizeof(vertex_t), edge_number_offset * sizeof(vertex_t), fd);
-        close(fd);
+        io().queue(slidshard_filename, adj_shard_arr, edges_read * sizeof(vertex_t), edge_number_offset * sizeof(vertex_t));
       }
       
       offset = keep_vertices_in_memory ? edge_number_offset : 0;
       
-      edge_data_arr = (value_t *) realloc(edge_data_arr, edges_read * sizeof(value_t));
-      if (hCache->noCacheMode()){
-        fd_edges = open(slidshard_edata_filename.c_str(), O_RDWR, 0777);
-        if (fd_edges == -1) handle_error(("opening "+ slidshard_edata_filename).c_str());
-        pread_sys(reinterpret_cast<char*>(&edge_data_arr[0]), edges_read * sizeof(value_t), edge_number_offset * sizeof(value_t),fd_edges);
-        close(fd_edges);
+      if (mapped){
+        /* out-edges are visited in the order of their sources */
+        edge_data_arr = MapWindow<EdgeValue>(edata_window, slidshard_edata_filename, edges_read, edge_number_offset, MADV_SEQUENTIAL);
       }
-      else{
-        off_t end_offset = edges_read * sizeof(value_t) + edge_number_offset * sizeof(value_t);
-        hCache->search_and_retrieve(shardID, edge_number_offset * sizeof(value_t), end_offset, edge_data_arr);
+      else if (hCache->noCacheMode()){
+        edge_data_arr = (EdgeValue *) realloc(edge_data_arr, edges_read * sizeof(EdgeValue));
+        io().queue(slidshard_edata_filename, edge_data_arr, edges_read * sizeof(EdgeValue), edge_number_offset * sizeof(EdgeValue));
       }
-      
-#pragma omp parallel for
-      for (int32_t i = first_index; i <= last_index; i++){
-        index_t dest_number;
-        vertex_t source_vid  = outbound_indices_arr[shardID][i].vID;
-        
-        if (i < number_of_vertices - 1){
-          dest_number = outbound_indices_arr[shardID][i+1].index - outbound_indices_arr[shardID][i].index;
-        }
-        else{
-          dest_number = number_of_edges - outbound_indices_arr[shardID][i].index;
-        }
-        uint32_t j = outbound_indices_arr[shardID][i].index - outbound_indices_arr[shardID][first_index].index;
-        while(dest_number--){
-          vertex_t dest_vid = adj_shard_arr[j + offset];
-          
-          vertices[source_vid].addOutedge(&vertices[dest_vid], &edge_data_arr[j]);
-          j++;
-        }
+      else{
+        edge_data_arr = (EdgeValue *) realloc(edge_data_arr, edges_read * sizeof(EdgeValue));
+        off_t end_offset = edges_read * sizeof(EdgeValue) + edge_number_offset * sizeof(EdgeValue);
+        hCache->search_and_retrieve(shardID, edge_number_offset * sizeof(EdgeValue), end_offset, edge_data_arr);
       }
-      return;
+      edge_tracker.add_window(shardID, edge_data_arr, edges_read, edge_number_offset, slidshard_edata_filename);
+      /* out-edges of the interval point into the loaded window */
+      hEdges->set_shard(shardID, adj_shard_arr + offset, edge_data_arr, edge_number_offset);
     }
     
   public:
     
-    Slidingshard(Outbound_t ** out, bool keep_vertices_in_memory, Cache * hCache):  keep_vertices_in_memory(keep_vertices_in_memory), edge_data_arr(NULL),
-    adj_shard_arr(NULL), hCache(hCache), outbound_indices_arr(out){}
+    /* one object per shard, its windows slide over the shard while the intervals advance */
+    Slidingshard(int16_t ID, uint32_t sources_num, Outbound_t ** out, bool keep_vertices_in_memory, Cache * hCache, bool mapped = false):
+    keep_vertices_in_memory(keep_vertices_in_memory), mapped(mapped), sources_num(sources_num), cursor(0), shardID(ID), edge_data_arr(NULL),
+    adj_shard_arr(NULL), hCache(hCache), outbound_indices_arr(out), cursor_lastID(-1)
+    {
+      adj_window.buffer = edata_window.buffer = NULL;
+    }
     
+    /* windows of interval groups may never be loaded */
     ~Slidingshard()
     {
-      CHECK(edge_data_arr);
+      if (mapped){
+        UnmapWindow(adj_window);
+        UnmapWindow(edata_window);
+        return;
+      }
       free(edge_data_arr);
       
       if (!keep_vertices_in_memory){
-        CHECK(adj_shard_arr);
         free(adj_shard_arr);
       }
     }
@@ -140,16 +145,11 @@ namespace GraphSN {
       this->adj_shard_arr = adj_shard_arr;
     }
     
-    void setID(int16_t ID)
-    {
-      this->shardID = ID;
-    }
-    
     uint16_t getID(){ return shardID; }
     
-    void prepare(Interval_t interval_bounds, uint32_t number_of_edges, GraphVertex * vertices)
+    void prepare(Interval_t interval_bounds, uint32_t number_of_edges, Edges * hEdges)
     {
-      this->vertices                 = vertices;
+      this->hEdges                   = hEdges;
       this->memshard_firstID         = interval_bounds.first_vid;
       this->memshard_lastID          = interval_bounds.last_vid;
       load_edges(number_of_edges);
@@ -0,0 +1,349 @@
+/*
+  streaming_engine.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef streaming_engine_hpp
+#define streaming_engine_hpp
+
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+
+#include "graph_objects.hpp"
+#include "graph_info.hpp"
+#include "vertex_values.hpp"
+
+#define STREAM_CHUNK_EDGES    (256L*1024L)          /* edges read from a shard at once */
+#define UPDATE_BUFFER_BYTES   (64L*1024L*1024L)     /* updates kept in memory before they are written to disk */
+#define STAGED_UPDATES        4096                  /* updates a scatter task stages before it appends them */
+
+namespace GraphSN {
+
+  template <typename VertexValue>
+  struct Update_t{
+    vertex_t      dst;
+    VertexValue   value;
+  };
+
+  /*
+      Edge-centric engine in the style of X-Stream. Every iteration streams the shards
+      sequentially (scatter), appends the updates to the buffer of the interval of their
+      destination, spilling it to disk when it grows, and then streams the updates of every
+      interval into the vertex values (gather). Since a shard holds the in-edges of one interval,
+      the updates of shard i belong to interval i, unless the program is undirected.
+      No GraphEdge objects are constructed.
+  */
+  template <typename VertexValue = value_t, typename EdgeValue = value_t>
+  class StreamingEngine{
+
+    typedef GraphVertex<VertexValue, EdgeValue>             Vertex;
+    typedef VertexStore<VertexValue, EdgeValue>             Store;
+    typedef GraphSNStreamingProgram<VertexValue, EdgeValue> Program;
+    typedef Update_t<VertexValue>                           Update;
+
+    bool                                      mmap_vertices;
+    std::vector < Interval_t >                intervals;
+    std::vector < uint32_t >                  intervals_edges;
+    std::vector < std::vector < Update > >    updates;          /* in-memory updates of every interval */
+    std::vector < uint64_t >                  spilled_updates;  /* updates of every interval written to disk */
+    std::mutex *                              updates_mtx;
+    uint64_t                                  interval_buffer_updates;
+    std::string                               updates_filename;
+    VertexValues<VertexValue> *               vertex_values;
+    Store *                                   store;
+    GraphBox *                                hGraphbox;
+
+    uint16_t interval_of(vertex_t ID)
+    {
+      uint16_t low = 0, high = intervals_number - 1;
+
+      while (low < high){
+        uint16_t middle = (low + high) / 2;
+        if (ID > intervals[middle].last_vid){
+          low = middle + 1;
+        }
+        else{
+          high = middle;
+        }
+      }
+      return low;
+    }
+
+    /**
+     * append_updates
+     *
+     * Appends staged updates to the buffer of an interval and writes the buffer to disk if it is full
+     *
+     * @param   intervalID    interval of the destinations
+     * @param   staged        staged updates, cleared on return
+     * @return  void
+     */
+    void append_updates(uint16_t intervalID, std::vector < Update >& staged)
+    {
+      std::lock_guard<std::mutex> lock(updates_mtx[intervalID]);
+
+      updates[intervalID].insert(updates[intervalID].end(), staged.begin(), staged.end());
+      staged.clear();
+      if (updates[intervalID].size() >= interval_buffer_updates){
+        int32_t fd;
+        std::string filename = updates_filename + std::to_string(intervalID);
+
+        fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+        if (fd == -1) handle_error(("opening " + filename).c_str());
+        write_sys(reinterpret_cast<char*>(&updates[intervalID][0]), updates[intervalID].size() * sizeof(Update), fd);
+        close(fd);
+        spilled_updates[intervalID] += updates[intervalID].size();
+        updates[intervalID].clear();
+      }
+    }
+
+    /**
+     * scatter_shard
+     *
+     * Streams the edges of a shard and scatters the ones of scheduled vertices
+     *
+     * @param   program   program
+     * @param   shardID   shardID
+     * @return  void
+     */
+    template <typename UserProgram>
+    void scatter_shard(UserProgram& program, uint16_t shardID)
+    {
+      int32_t fd_adj, fd_edata;
+      uint32_t sources_num, source = 0;
+      Outbound_t * sources;
+      vertex_t * adj;
+      EdgeValue * edata;
+      bool undirected = program.undirected();
+      Scheduler * scheduler = hGraphbox->scheduler;
+      std::vector < std::vector < Update > > staged(intervals_number);
+      std::string outbound_filename = inFolder + "Outbound/outbound_indices_" + std::to_string(shardID) + ".binary";
+      std::string adj_filename = shard_filename + std::to_string(shardID);
+      std::string edata_filename = edge_data_filename + std::to_string(shardID);
+
+      if (intervals_edges[shardID] == 0){
+        return;
+      }
+      /* sources of the shard and the position of their first edge */
+      sources_num = GetElementsNumber(outbound_filename, sizeof(Outbound_t));
+      sources = (Outbound_t *) malloc(sources_num * sizeof(Outbound_t));
+      fd_adj = open(outbound_filename.c_str(), O_RDONLY);
+      if (fd_adj == -1) handle_error(("opening " + outbound_filename).c_str());
+      read_sys(reinterpret_cast<char*>(sources), sources_num * sizeof(Outbound_t), fd_adj);
+      close(fd_adj);
+
+      fd_adj = open(adj_filename.c_str(), O_RDONLY);
+      if (fd_adj == -1) handle_error(("opening " + adj_filename).c_str());
+      fd_edata = open(edata_filename.c_str(), O_RDONLY);
+      if (fd_edata == -1) handle_error(("opening " + edata_filename).c_str());
+      posix_fadvise(fd_adj, 0, 0, POSIX_FADV_SEQUENTIAL);
+      posix_fadvise(fd_edata, 0, 0, POSIX_FADV_SEQUENTIAL);
+      adj = (vertex_t *) malloc(STREAM_CHUNK_EDGES * sizeof(vertex_t));
+      edata = (EdgeValue *) malloc(STREAM_CHUNK_EDGES * sizeof(EdgeValue));
+
+      for (uint32_t first = 0; first < intervals_edges[shardID]; first += STREAM_CHUNK_EDGES){
+        uint32_t last = (uint32_t) std::min<uint64_t>(first + STREAM_CHUNK_EDGES, intervals_edges[shardID]);
+        uint32_t chunk_source = source;
+        bool scheduled = undirected;
+
+        /* chunks without scheduled sources are not read at all, unless destinations scatter too */
+        for (uint32_t s = source; !scheduled && s < sources_num && sources[s].index < last; s++){
+          if (scheduler->is_scheduled(sources[s].vID)){
+            scheduled = true;
+            break;
+          }
+        }
+        if (scheduled){
+          pread_sys(reinterpret_cast<char*>(adj), (last - first) * sizeof(vertex_t), (off_t) first * sizeof(vertex_t), fd_adj);
+          pread_sys(reinterpret_cast<char*>(edata), (last - first) * sizeof(EdgeValue), (off_t) first * sizeof(EdgeValue), fd_edata);
+        }
+        for (uint32_t edge = first; edge < last; edge++){
+          vertex_t src, dst;
+          VertexValue update;
+
+          while (chunk_source + 1 < sources_num && sources[chunk_source + 1].index <= edge){
+            chunk_source++;
+          }
+          src = sources[chunk_source].vID;
+          if (!scheduled){
+            continue;
+          }
+          dst = adj[edge - first];
+          if (scheduler->is_scheduled(src) &&
+              program.scatter(src, Vertex(src, store).getData(), dst, edata[edge - first], update, *hGraphbox)){
+            Update new_update = {dst, update};
+            staged[shardID].push_back(new_update);
+            if (staged[shardID].size() == STAGED_UPDATES){
+              append_updates(shardID, staged[shardID]);
+            }
+          }
+          if (undirected && scheduler->is_scheduled(dst) &&
+              program.scatter(dst, Vertex(dst, store).getData(), src, edata[edge - first], update, *hGraphbox)){
+            Update new_update = {src, update};
+            uint16_t intervalID = interval_of(src);
+            staged[intervalID].push_back(new_update);
+            if (staged[intervalID].size() == STAGED_UPDATES){
+              append_updates(intervalID, staged[intervalID]);
+            }
+          }
+        }
+        source = chunk_source;
+      }
+      for (uint16_t intervalID = 0; intervalID < intervals_number; intervalID++){
+        if (!staged[intervalID].empty()){
+          append_updates(intervalID, staged[intervalID]);
+        }
+      }
+      free(adj);
+      free(edata);
+      free(sources);
+      close(fd_adj);
+      close(fd_edata);
+    }
+
+    /**
+     * gather_interval
+     *
+     * Streams the updates of an interval, first the ones written to disk, into the vertex values
+     *
+     * @param   program       program
+     * @param   intervalID    intervalID
+     * @return  void
+     */
+    template <typename UserProgram>
+    void gather_interval(UserProgram& program, uint16_t intervalID)
+    {
+      std::vector < Update >& buffer = updates[intervalID];
+
+      vertex_values->advise_interval(intervals[intervalID].first_vid, intervals[intervalID].last_vid);
+      if (spilled_updates[intervalID]){
+        int32_t fd;
+        std::string filename = updates_filename + std::to_string(intervalID);
+        std::vector < Update > spilled(std::min<uint64_t>(spilled_updates[intervalID], interval_buffer_updates));
+
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) handle_error(("opening " + filename).c_str());
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        for (uint64_t first = 0; first < spilled_updates[intervalID]; first += spilled.size()){
+          uint64_t count = std::min<uint64_t>(spilled.size(), spilled_updates[intervalID] - first);
+
+          read_sys(reinterpret_cast<char*>(&spilled[0]), count * sizeof(Update), fd);
+          parallel_for<uint64_t>(0, count, [&](uint64_t i){
+            Vertex vertex(spilled[i].dst, store);
+            
+            program.gather(vertex, spilled[i].value, *hGraphbox);
+          });
+        }
+        close(fd);
+        remove(filename.c_str());
+        spilled_updates[intervalID] = 0;
+      }
+      parallel_for<uint64_t>(0, buffer.size(), [&](uint64_t i){
+        Vertex vertex(buffer[i].dst, store);
+        
+        program.gather(vertex, buffer[i].value, *hGraphbox);
+      });
+      buffer.clear();
+    }
+
+  public:
+
+    StreamingEngine()
+    {
+      LoadShardsInfo();
+      LoadIntervals(intervals);
+      LoadIntervalsEdges(intervals_edges);
+
+      this->mmap_vertices = MMAP_VERTICES;
+      vertex_values = new VertexValues<VertexValue>();
+      vertex_values->load(inFolder + "vertex_data", vertices_number, mmap_vertices);
+      store = new Store(vertex_values);
+
+      updates.resize(intervals_number);
+      spilled_updates.resize(intervals_number, 0);
+      updates_mtx = new std::mutex[intervals_number];
+      interval_buffer_updates = std::max<uint64_t>(STAGED_UPDATES, UPDATE_BUFFER_BYTES / sizeof(Update) / intervals_number);
+      check_directory((inFolder + "Updates").c_str());
+      updates_filename = inFolder + "Updates/updates_";
+    }
+
+    ~StreamingEngine()
+    {
+      delete vertex_values;
+      delete store;
+      delete [] updates_mtx;
+    }
+
+    void run(Program& program, uint32_t iterations_num)
+    {
+      run<Program>(program, iterations_num);
+    }
+
+    /**
+     * run
+     *
+     * Runs a program whose functions are called directly, see StaticProgram
+     *
+     * @param   program         program, of type UserProgram
+     * @param   iterations_num  maximum number of iterations
+     * @return  void
+     */
+    template <typename UserProgram>
+    void run(typename StaticProgram<UserProgram>::type& program, uint32_t iterations_num)
+    {
+      this->hGraphbox = new GraphBox(iterations_num, vertices_number);
+
+      LOG("Streaming engine\n");
+      timer.start("run");
+      parallel_for<vertex_t>(0, vertices_number, [&](vertex_t i){
+        Vertex vertex(i, store);
+        
+        program.initialize(vertex, *hGraphbox);
+      });
+      for (uint32_t iter = 0; iter < iterations_num; iter++){
+        /* start of iteration loop */
+        if (iter >= hGraphbox->get_iterations_num()){
+          break;
+        }
+        if (!hGraphbox->scheduler->has_tasks){
+          break;
+        }
+
+        hGraphbox->reset_aggregators();
+        program.before_iteration(*hGraphbox);
+        {
+          /* scatter */
+          TaskGroup scatter_tasks;
+          for (uint16_t shardID = 0; shardID < intervals_number; shardID++){
+            scatter_tasks.run([this, &program, shardID](){
+              scatter_shard(program, shardID);
+            });
+          }
+          scatter_tasks.wait();
+        }
+        for (uint16_t exec_inter = 0; exec_inter < intervals_number; exec_inter++){
+          /* gather */
+          program.before_exec_interval(*hGraphbox);
+          gather_interval(program, exec_inter);
+          hGraphbox->merge_aggregators();
+          program.after_exec_interval(*hGraphbox);
+          if (mmap_vertices){
+            vertex_values->write_back(false);
+          }
+        }
+        hGraphbox->merge_aggregators();
+        program.after_iteration(*hGraphbox);
+        hGraphbox->increment_iteration();
+        hGraphbox->scheduler->swap();
+      } /* end of iteration loop */
+      timer.end("run");
+
+      vertex_values->save();
+      delete hGraphbox;
+    }
+  };
+}
+
+#endif /* streaming_engine_hpp */
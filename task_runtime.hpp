@@ -0,0 +1,410 @@
+/*
+  task_runtime.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef task_runtime_hpp
+#define task_runtime_hpp
+
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <sched.h>
+#include <pthread.h>
+
+#include "log.hpp"
+
+#define PIN_WORKERS false   /* bind every worker to its own core */
+
+namespace GraphSN {
+
+  class TaskGroup;
+
+  typedef struct Task_s{
+    std::function<void()> function;
+    TaskGroup * group;
+  }Task_t;
+
+  /*
+      Work-stealing runtime: one worker per core, every worker owns a deque.
+      A worker pushes and pops its own tasks from the back of its deque and steals
+      from the front of the others. Threads that wait for a group while being workers
+      keep executing the tasks of that group, so nested parallel loops never need extra threads.
+  */
+  class TaskRuntime{
+
+    typedef struct Worker_s{
+      std::mutex          mtx;
+      std::deque<Task_t>  tasks;
+    }Worker_t;
+
+    uint32_t                  workers_num;
+    Worker_t *                workers;
+    std::vector<std::thread>  threads;
+    std::atomic<uint64_t>     queued_tasks;
+    std::atomic<uint32_t>     next_victim;
+    std::atomic<bool>         stopped;
+    std::mutex                sleep_mtx;
+    std::condition_variable   wake_up;
+
+    static int32_t& current_worker()
+    {
+      static thread_local int32_t workerID = -1;
+      return workerID;
+    }
+
+    bool pop_local(uint32_t workerID, Task_t& task)
+    {
+      std::lock_guard<std::mutex> lock(workers[workerID].mtx);
+      if (workers[workerID].tasks.empty()){
+        return false;
+      }
+      task = std::move(workers[workerID].tasks.back());
+      workers[workerID].tasks.pop_back();
+      return true;
+    }
+
+    bool steal(uint32_t thiefID, Task_t& task)
+    {
+      for (uint32_t i = 1; i <= workers_num; i++){
+        uint32_t victim = (thiefID + i) % workers_num;
+        std::lock_guard<std::mutex> lock(workers[victim].mtx);
+        if (!workers[victim].tasks.empty()){
+          task = std::move(workers[victim].tasks.front());
+          workers[victim].tasks.pop_front();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /* a task of group, the newest of the own deque or the oldest of another one */
+    bool take_group_task(uint32_t workerID, TaskGroup * group, Task_t& task)
+    {
+      for (uint32_t i = 0; i < workers_num; i++){
+        uint32_t victim = (workerID + i) % workers_num;
+        std::lock_guard<std::mutex> lock(workers[victim].mtx);
+        std::deque<Task_t>& tasks = workers[victim].tasks;
+
+        for (size_t j = 0; j < tasks.size(); j++){
+          size_t index = (i == 0) ? tasks.size() - 1 - j : j;
+
+          if (tasks[index].group == group){
+            task = std::move(tasks[index]);
+            tasks.erase(tasks.begin() + index);
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    bool find_task(uint32_t workerID, Task_t& task)
+    {
+      if (queued_tasks.load() == 0){
+        return false;
+      }
+      if (pop_local(workerID, task) || steal(workerID, task)){
+        queued_tasks--;
+        return true;
+      }
+      return false;
+    }
+
+    void execute(Task_t& task);
+
+    void worker_loop(uint32_t workerID)
+    {
+      Task_t task;
+
+      current_worker() = workerID;
+      while (true){
+        if (find_task(workerID, task)){
+          execute(task);
+          continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        while (queued_tasks.load() == 0 && !stopped.load()){
+          wake_up.wait(lock);
+        }
+        if (stopped.load() && queued_tasks.load() == 0){
+          return;
+        }
+      }
+    }
+
+  public:
+
+    TaskRuntime(): workers_num(0), workers(NULL), queued_tasks(0), next_victim(0), stopped(false){}
+
+    ~TaskRuntime()
+    {
+      stop();
+    }
+
+    /**
+     * start
+     *
+     * Spawns the workers of the runtime
+     *
+     * @param   threads_num   number of workers, normally the number of cores
+     * @return  void
+     */
+    void start(uint32_t threads_num)
+    {
+      CHECK(workers_num == 0);
+      workers_num = threads_num ? threads_num : 1;
+      workers = new Worker_t[workers_num];
+      for (uint32_t i = 0; i < workers_num; i++){
+        threads.push_back(std::thread(&TaskRuntime::worker_loop, this, i));
+      }
+      if (PIN_WORKERS){
+        pin_workers();
+      }
+      DBG_LOG("Task runtime started with %u workers\n", workers_num);
+    }
+
+    /**
+     * pin_workers
+     *
+     * Binds worker i to the i-th core the process may run on, so that workers don't
+     * migrate away from the memory of their node
+     *
+     * @return  void
+     */
+    void pin_workers()
+    {
+      cpu_set_t allowed;
+      std::vector<int32_t> cores;
+
+      if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1){
+        return;
+      }
+      for (int32_t core = 0; core < CPU_SETSIZE; core++){
+        if (CPU_ISSET(core, &allowed)){
+          cores.push_back(core);
+        }
+      }
+      for (uint32_t i = 0; i < threads.size() && !cores.empty(); i++){
+        cpu_set_t core_set;
+
+        CPU_ZERO(&core_set);
+        CPU_SET(cores[i % cores.size()], &core_set);
+        if (pthread_setaffinity_np(threads[i].native_handle(), sizeof(core_set), &core_set)){
+          LOG("Worker %u was not pinned\n", i);
+        }
+      }
+    }
+
+    void stop()
+    {
+      if (!workers_num){
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+        stopped = true;
+      }
+      wake_up.notify_all();
+      for (uint32_t i = 0; i < threads.size(); i++){
+        threads[i].join();
+      }
+      threads.clear();
+      delete [] workers;
+      workers = NULL;
+      workers_num = 0;
+    }
+
+    uint32_t get_workers_num()
+    {
+      return workers_num;
+    }
+
+    /**
+     * worker_id
+     *
+     * @return  ID of the calling worker, -1 if the caller is not a worker of the runtime
+     */
+    static int32_t worker_id()
+    {
+      return current_worker();
+    }
+
+    /**
+     * submit
+     *
+     * Pushes a task to the deque of the calling worker. Tasks submitted from threads
+     * outside the runtime are spread over the deques in a round robin fashion.
+     *
+     * @param   task  task to be executed
+     * @return  void
+     */
+    void submit(Task_t task)
+    {
+      int32_t workerID = current_worker();
+      uint32_t target;
+
+      CHECK(workers_num);
+      target = (workerID >= 0) ? (uint32_t) workerID : next_victim++ % workers_num;
+      {
+        std::lock_guard<std::mutex> lock(workers[target].mtx);
+        workers[target].tasks.push_back(std::move(task));
+      }
+      queued_tasks++;
+      {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+      }
+      wake_up.notify_one();
+    }
+
+    /**
+     * help
+     *
+     * Executes one pending task of a group on behalf of a worker that waits for it. Only tasks
+     * of the group are taken, so the waiter never runs an unrelated task that blocks, e.g. one
+     * that waits for I/O or for an outer group, and its stack only grows with nested groups.
+     *
+     * @param   group   group the worker waits for
+     * @return  true if a task was executed
+     */
+    bool help(TaskGroup * group)
+    {
+      Task_t task;
+      int32_t workerID = current_worker();
+
+      if (workerID < 0 || queued_tasks.load() == 0 || !take_group_task((uint32_t) workerID, group, task)){
+        return false;
+      }
+      queued_tasks--;
+      execute(task);
+      return true;
+    }
+
+    template <typename Index, typename Function>
+    void parallel_for(Index first, Index last, Function function, Index grain = 0);
+  };
+
+  TaskRuntime runtime;
+
+  class TaskGroup{
+
+    std::atomic<uint32_t>   pending;
+    std::mutex              mtx;
+    std::condition_variable done;
+
+  public:
+
+    TaskGroup(): pending(0){}
+
+    ~TaskGroup()
+    {
+      wait();
+    }
+
+    void run(std::function<void()> function)
+    {
+      Task_t task;
+
+      pending++;
+      task.function = std::move(function);
+      task.group = this;
+      runtime.submit(std::move(task));
+    }
+
+    void finished()
+    {
+      /* the last task notifies under the lock, so the group can't be destroyed before it unlocks */
+      std::lock_guard<std::mutex> lock(mtx);
+      if (--pending == 0){
+        done.notify_all();
+      }
+    }
+
+    /**
+     * wait
+     *
+     * Waits until every task of the group has finished. A worker keeps executing
+     * the tasks of the group while waiting, other threads sleep.
+     *
+     * @return  void
+     */
+    void wait()
+    {
+      if (TaskRuntime::worker_id() >= 0){
+        while (pending.load()){
+          if (!runtime.help(this)){
+            std::this_thread::yield();
+          }
+        }
+      }
+      std::unique_lock<std::mutex> lock(mtx);
+      while (pending.load()){
+        done.wait(lock);
+      }
+    }
+  };
+
+  void TaskRuntime::execute(Task_t& task)
+  {
+    task.function();
+    if (task.group){
+      task.group->finished();
+    }
+  }
+
+  /**
+   * parallel_for
+   *
+   * Splits [first,last) in chunks and runs function(i) for every index of the range
+   *
+   * @param   first     first index
+   * @param   last      one past the last index
+   * @param   function  body of the loop
+   * @param   grain     indices per chunk, 0 lets the runtime choose
+   * @return  void
+   */
+  template <typename Index, typename Function>
+  void TaskRuntime::parallel_for(Index first, Index last, Function function, Index grain)
+  {
+    TaskGroup group;
+    uint64_t  range;
+
+    if (last <= first){
+      return;
+    }
+    range = (uint64_t) (last - first);
+    if (grain == 0){
+      grain = (Index) std::max<uint64_t>(1, range / (workers_num * 8));
+    }
+    if (range <= (uint64_t) grain || workers_num == 1){
+      for (Index i = first; i < last; i++){
+        function(i);
+      }
+      return;
+    }
+    while (first < last){
+      Index chunk_end = (last - first > grain) ? first + grain : last;
+      group.run([first, chunk_end, &function](){
+        for (Index i = first; i < chunk_end; i++){
+          function(i);
+        }
+      });
+      first = chunk_end;
+    }
+    group.wait();
+  }
+
+  template <typename Index, typename Function>
+  inline void parallel_for(Index first, Index last, Function function, Index grain = 0)
+  {
+    runtime.parallel_for(first, last, function, grain);
+  }
+}
+
+#endif /* task_runtime_hpp */
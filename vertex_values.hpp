@@ -0,0 +1,445 @@
+/*
+  vertex_values.hpp
+  Thesis
+  Copyright © 2016 Theodore Michailidis. All rights reserved.
+*/
+
+#ifndef vertex_values_hpp
+#define vertex_values_hpp
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "types.hpp"
+#include "files.hpp"
+#include "task_runtime.hpp"
+#include "placement.hpp"
+
+#define CACHE_LINE_SIZE   64
+#define VALUES_PER_LINE(type)   std::max<size_t>(CACHE_LINE_SIZE / sizeof(type), 1)
+#define PAGE_WRITE_BACK   1   /* page has to be written to the vertex data file */
+#define PAGE_CHECKPOINT   2   /* page has changed since the last checkpoint */
+#define PAGE_ITERATION    4   /* page has changed in the current iteration */
+
+namespace GraphSN {
+
+  /*
+      Values of the vertices, either read in a malloc'ed array or memory mapped
+      from the vertex data file. Modified pages are tracked through GraphVertex::setData,
+      so only those are written back (pwrite for the array, msync for the mapping).
+      In synchronous mode a second, read-only copy holds the values of the previous
+      iteration; the pages written during an iteration are copied to it when it ends.
+      Pages are pages of the file, a value may span two of them. Read-only values are never
+      written back, a mapping of them is private.
+  */
+  template <typename VertexValue = value_t>
+  class VertexValues{
+
+    bool            mapped;
+    bool            read_only;
+    int32_t         fd;
+    VertexValue *   data;
+    VertexValue *   previous;   /* values of the previous iteration, synchronous mode only */
+    uint32_t        vertices_num;
+    uint32_t        page_size;
+    uint32_t        pages_num;
+    uint8_t *     dirty;      /* PAGE_* flags for every page of the file */
+    std::string   filename;
+
+  public:
+
+    VertexValues(): mapped(false), read_only(false), fd(-1), data(NULL), previous(NULL), vertices_num(0), page_size(0), pages_num(0), dirty(NULL){}
+
+    ~VertexValues()
+    {
+      if (data){
+        save();
+      }
+    }
+
+    /**
+     * load
+     *
+     * Load the values of the vertices from disk
+     *
+     * @param   vertex_data_filename  vertex data file
+     * @param   vertices_number       number of vertices
+     * @param   memory_mapped         map the file instead of reading it
+     * @param   read_only             the values are dropped instead of written back
+     * @return  void
+     */
+    void load(std::string vertex_data_filename, uint32_t vertices_number, bool memory_mapped, bool read_only = false)
+    {
+      CHECK(data == NULL);
+      filename        = vertex_data_filename;
+      vertices_num    = vertices_number;
+      mapped          = memory_mapped;
+      this->read_only = read_only;
+      page_size       = (uint32_t) getpagesize();
+      pages_num       = (uint32_t) (bytes() / page_size + ((bytes() % page_size)? 1:0));
+      dirty           = (uint8_t *) calloc(pages_num ? pages_num : 1, sizeof(uint8_t));
+
+      if (mapped){
+        data = (VertexValue *) CreateMmap(fd, filename, bytes(), 0, !read_only);
+        /* neighbours are visited in random order, read ahead only inside the current interval */
+        if (madvise(data, bytes(), MADV_RANDOM) == -1) handle_error(("madvising " + filename).c_str());
+      }
+      else{
+        fd = open(filename.c_str(), read_only ? O_RDONLY : O_RDWR);
+        if (fd == -1) handle_error(filename.c_str());
+        /* aligned, so that vertices updated by different workers never share a cache line */
+        data = (VertexValue *) allocate_array(bytes(), CACHE_LINE_SIZE);
+        read_sys(reinterpret_cast<char*>(&data[0]), bytes(), fd);
+      }
+    }
+
+    /**
+     * copy
+     *
+     * Read-only values in memory that start from the current values of another instance,
+     * without reading the vertex data file again
+     *
+     * @param   source    loaded values
+     * @return  void
+     */
+    void copy(VertexValues& source)
+    {
+      CHECK(data == NULL);
+      filename      = source.filename;
+      vertices_num  = source.vertices_num;
+      mapped        = false;
+      read_only     = true;
+      page_size     = source.page_size;
+      pages_num     = source.pages_num;
+      dirty         = (uint8_t *) calloc(pages_num ? pages_num : 1, sizeof(uint8_t));
+      data          = (VertexValue *) allocate_array(bytes(), CACHE_LINE_SIZE);
+      memcpy(data, source.data, bytes());
+    }
+
+    /**
+     * reset
+     *
+     * Read-only values return to those of another instance, only the pages written since are copied
+     *
+     * @param   source    values to return to
+     * @return  void
+     */
+    void reset(VertexValues& source)
+    {
+      CHECK(read_only && source.vertices_num == vertices_num);
+      parallel_for<uint32_t>(0, pages_num, [&](uint32_t pageID){
+        if (dirty[pageID] & PAGE_WRITE_BACK){
+          size_t length;
+          char * start = page(pageID, length);
+          size_t offset = start - reinterpret_cast<char*>(data);
+
+          memcpy(start, reinterpret_cast<char*>(source.data) + offset, length);
+          if (previous){
+            memcpy(reinterpret_cast<char*>(previous) + offset, start, length);
+          }
+        }
+        dirty[pageID] = 0;
+      });
+    }
+
+    /**
+     * set_read_only
+     *
+     * Changes whether the values are written back. Nothing may have been written since they were
+     * loaded or saved; a mapping is replaced, so the stores have to be bound again.
+     *
+     * @param   read_only   the values are dropped instead of written back
+     * @return  void
+     */
+    void set_read_only(bool read_only)
+    {
+      if (read_only == this->read_only){
+        return;
+      }
+      for (uint32_t i = 0; i < pages_num; i++){
+        CHECK(!(dirty[i] & PAGE_WRITE_BACK));
+      }
+      this->read_only = read_only;
+      if (mapped){
+        /* a shared mapping writes to the file, a private one doesn't */
+        DestroyMmap(fd, filename, data, bytes(), false);
+        data = (VertexValue *) CreateMmap(fd, filename, bytes(), 0, !read_only);
+        if (madvise(data, bytes(), MADV_RANDOM) == -1) handle_error(("madvising " + filename).c_str());
+      }
+      else if (fd != -1){
+        close(fd);
+        fd = open(filename.c_str(), read_only ? O_RDONLY : O_RDWR);
+        if (fd == -1) handle_error(filename.c_str());
+      }
+    }
+
+    VertexValue * get(vertex_t ID)
+    {
+      return &data[ID];
+    }
+
+    /**
+     * get_read
+     *
+     * @param   ID    vertexID
+     * @return  value that updates read, the one of the previous iteration in synchronous mode
+     */
+    VertexValue * get_read(vertex_t ID)
+    {
+      return previous ? &previous[ID] : &data[ID];
+    }
+
+    /**
+     * set_synchronous
+     *
+     * Allocates or releases the values of the previous iteration
+     *
+     * @param   synchronous   synchronous mode
+     * @return  void
+     */
+    void set_synchronous(bool synchronous)
+    {
+      if (synchronous && !previous){
+        previous = (VertexValue *) allocate_array(bytes(), CACHE_LINE_SIZE);
+        memcpy(previous, data, bytes());
+        for (uint32_t i = 0; i < pages_num; i++){
+          dirty[i] &= ~PAGE_ITERATION;
+        }
+      }
+      else if (!synchronous && previous){
+        free(previous);
+        previous = NULL;
+      }
+    }
+
+    /**
+     * end_iteration
+     *
+     * Makes the values written during the iteration visible to the next one
+     *
+     * @return  void
+     */
+    void end_iteration()
+    {
+      if (!previous){
+        return;
+      }
+      parallel_for<uint32_t>(0, pages_num, [&](uint32_t pageID){
+        if (dirty[pageID] & PAGE_ITERATION){
+          size_t length;
+          char * start = page(pageID, length);
+
+          memcpy(reinterpret_cast<char*>(previous) + (start - reinterpret_cast<char*>(data)), start, length);
+          dirty[pageID] &= ~PAGE_ITERATION;
+        }
+      });
+    }
+
+    bool is_mapped()
+    {
+      return mapped;
+    }
+
+    size_t bytes()
+    {
+      return (size_t) vertices_num * sizeof(VertexValue);
+    }
+
+    uint32_t get_pages_num()
+    {
+      return pages_num;
+    }
+
+    /**
+     * page_range
+     *
+     * Page aligned part of the values that contains [firstID, lastID]
+     *
+     * @param   firstID   first vertex
+     * @param   lastID    last vertex
+     * @param   length    length of the range in bytes
+     * @return  start of the range
+     */
+    char * page_range(vertex_t firstID, vertex_t lastID, size_t& length)
+    {
+      size_t first = (size_t) firstID * sizeof(VertexValue) / page_size * page_size;
+      size_t end = std::min(bytes(), ((size_t) (lastID + 1) * sizeof(VertexValue) + page_size - 1) / page_size * page_size);
+
+      length = end - first;
+      return reinterpret_cast<char*>(data) + first;
+    }
+
+    /**
+     * page
+     *
+     * @param   pageID    page of the vertex data file
+     * @param   length    length of the page in bytes, the last page may be shorter
+     * @return  start of the page
+     */
+    char * page(uint32_t pageID, size_t& length)
+    {
+      size_t first = (size_t) pageID * page_size;
+
+      length = std::min(bytes(), first + page_size) - first;
+      return reinterpret_cast<char*>(data) + first;
+    }
+
+    /**
+     * mark_dirty
+     *
+     * Marks the pages that contain the value of a vertex as modified
+     *
+     * @param   ID    vertexID
+     * @return  void
+     */
+    void mark_dirty(vertex_t ID)
+    {
+      size_t first = (size_t) ID * sizeof(VertexValue);
+
+      for (size_t page = first / page_size; page <= (first + sizeof(VertexValue) - 1) / page_size; page++){
+        /* the flags of a page are shared by its vertices, the line is written only when a flag is missing */
+        if (__atomic_load_n(&dirty[page], __ATOMIC_RELAXED) != (PAGE_WRITE_BACK | PAGE_CHECKPOINT | PAGE_ITERATION)){
+          __atomic_store_n(&dirty[page], PAGE_WRITE_BACK | PAGE_CHECKPOINT | PAGE_ITERATION, __ATOMIC_RELAXED);
+        }
+      }
+    }
+
+    /**
+     * advise_interval
+     *
+     * Tells the kernel that the values of an interval are about to be updated
+     *
+     * @param   firstID   first vertex of the interval
+     * @param   lastID    last vertex of the interval
+     * @return  void
+     */
+    void advise_interval(vertex_t firstID, vertex_t lastID)
+    {
+      size_t length;
+      char * start;
+
+      if (!mapped || !vertices_num){
+        return;
+      }
+      start = page_range(firstID, lastID, length);
+      if (madvise(start, length, MADV_WILLNEED) == -1) handle_error(("madvising " + filename).c_str());
+    }
+
+    /**
+     * write_back
+     *
+     * Writes the modified pages to disk and clears their dirty flags.
+     * Consecutive dirty pages are written together. An asynchronous write back
+     * of the mapping keeps the flags, so that the final one can wait for those pages.
+     *
+     * @param   sync    wait for the mapped pages to reach the disk
+     * @return  number of pages written
+     */
+    uint32_t write_back(bool sync)
+    {
+      uint32_t page = 0, written = 0;
+
+      if (read_only){
+        return 0;
+      }
+      while (page < pages_num){
+        uint32_t run_end;
+        size_t length;
+        char * start;
+
+        if (!(dirty[page] & PAGE_WRITE_BACK)){
+          page++;
+          continue;
+        }
+        run_end = page;
+        while (run_end < pages_num && (dirty[run_end] & PAGE_WRITE_BACK)){
+          if (sync || !mapped){
+            dirty[run_end] &= ~PAGE_WRITE_BACK;
+          }
+          run_end++;
+        }
+        start = this->page(page, length);
+        length = std::min(bytes(), (size_t) run_end * page_size) - (size_t) page * page_size;
+        if (mapped){
+          if (msync(start, length, sync ? MS_SYNC : MS_ASYNC) == -1) handle_error(("msyncing " + filename).c_str());
+        }
+        else{
+          pwrite_sys(start, length, (off_t) page * page_size, fd);
+        }
+        written += run_end - page;
+        page = run_end;
+      }
+      return written;
+    }
+
+    /**
+     * collect_checkpoint_pages
+     *
+     * Finds the pages changed since the last checkpoint and clears their flags
+     *
+     * @param   pages   changed pages, in increasing order
+     * @return  void
+     */
+    void collect_checkpoint_pages(std::vector<uint32_t>& pages)
+    {
+      pages.clear();
+      for (uint32_t i = 0; i < pages_num; i++){
+        if (dirty[i] & PAGE_CHECKPOINT){
+          pages.push_back(i);
+          dirty[i] &= ~PAGE_CHECKPOINT;
+        }
+      }
+    }
+    
+    /**
+     * restored
+     *
+     * Called after the values have been overwritten by a checkpoint, every page has to be written back
+     *
+     * @return  void
+     */
+    void restored()
+    {
+      for (uint32_t i = 0; i < pages_num; i++){
+        dirty[i] = PAGE_WRITE_BACK;
+      }
+      if (previous){
+        memcpy(previous, data, bytes());
+      }
+    }
+
+    /**
+     * save
+     *
+     * Writes the modified pages to disk and releases the values
+     *
+     * @return  void
+     */
+    void save()
+    {
+      uint32_t written = write_back(true);
+
+      LOG("%u/%u vertex data pages written back\n", written, pages_num);
+      if (mapped){
+        DestroyMmap(fd, filename, data, bytes(), false);
+      }
+      else{
+        free(data);
+        if (fd != -1){
+          close(fd);
+        }
+      }
+      free(dirty);
+      free(previous);
+      data = NULL;
+      dirty = NULL;
+      previous = NULL;
+    }
+  };
+}
+
+#endif /* vertex_values_hpp */